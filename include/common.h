@@ -82,6 +82,21 @@ inline bool isDeviceAccessible(void* ptr){
  * @brief Enum for error checking in Hahsinator.
  */
 namespace Hashinator {
+/**
+ * @brief Hints the host to pull the cache line holding ptr ahead of use.
+ *
+ * Used by the batched host lookups to overlap the cache misses of independent probes.
+ * Compiles to nothing where the builtin is not available.
+ */
+inline void prefetch(const void* ptr) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+   __builtin_prefetch(ptr, 0, 3);
+#else
+   (void)ptr;
+#endif
+}
+
+
 enum status { success, fail, invalid };
 
 /**
@@ -0,0 +1,151 @@
+/* File:    blocked_bloom.h
+ * Authors: Kostis Papadakis, Urs Ganse and Markus Battarbee (2023)
+ * Description: Cache line blocked Bloom filter used by Hashmap to
+ *              answer most negative lookups without probing.
+ *
+ * This file defines the following classes:
+ *    --Hashinator::BlockedBloomFilter;
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ * */
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+namespace Hashinator {
+
+/**
+ * @brief Bloom filter whose bits for one key all live in a single 64 byte block.
+ *
+ * A key selects one block with the low bits of its hash and sets k bits inside it, so both
+ * insertion and a negative lookup touch exactly one cache line. The filter is sized for a
+ * capacity and a target false positive rate; it cannot delete, so stale keys only cost false
+ * positives until the owner rebuilds it.
+ */
+class BlockedBloomFilter {
+   struct alignas(64) Block {
+      uint64_t words[8];
+   };
+
+public:
+   BlockedBloomFilter() = default;
+
+   BlockedBloomFilter(size_t capacity, float falsePositiveRate) { reset(capacity, falsePositiveRate); }
+
+   // Clears the filter and sizes it for capacity keys at falsePositiveRate
+   void reset(size_t capacity, float falsePositiveRate) {
+      fpRate = std::min(std::max(falsePositiveRate, 1e-6f), 0.5f);
+      const double bitsPerKey = -std::log2(double(fpRate));
+      // Blocking skews the load of the blocks, which costs roughly half a bit per key per hash
+      nHashes = std::min(16, std::max(1, static_cast<int>(std::lround(bitsPerKey))));
+      const double bits = std::max(double(capacity), 1.0) * bitsPerKey * 1.6;
+      size_t nBlocks = 1;
+      while (nBlocks * 512 < bits) {
+         nBlocks <<= 1;
+      }
+      blocks.assign(nBlocks, Block{});
+   }
+
+   // Keeps the size and rate but forgets all keys
+   void clear() { std::fill(blocks.begin(), blocks.end(), Block{}); }
+
+   // Releases the memory, after which the filter reports every key as possibly present
+   void release() { std::vector<Block>().swap(blocks); }
+
+   bool enabled() const noexcept { return !blocks.empty(); }
+   float false_positive_rate() const noexcept { return fpRate; }
+   size_t bytes() const noexcept { return blocks.size() * sizeof(Block); }
+
+   template <typename T>
+   void insert(const T& key) noexcept {
+      uint64_t mask[8] = {};
+      Block& block = blocks[_masks(key, mask)];
+      for (int w = 0; w < 8; ++w) {
+         block.words[w] |= mask[w];
+      }
+   }
+
+#ifdef __cpp_lib_atomic_ref
+   // Same as insert but safe against other threads inserting at the same time. Words that
+   // already hold their bits are only loaded, so hot blocks are not written over and over.
+   template <typename T>
+   void insert_concurrent(const T& key) noexcept {
+      uint64_t mask[8] = {};
+      Block& block = blocks[_masks(key, mask)];
+      for (int w = 0; w < 8; ++w) {
+         if (mask[w] == 0) {
+            continue;
+         }
+         std::atomic_ref<uint64_t> word(block.words[w]);
+         if ((word.load(std::memory_order_relaxed) & mask[w]) != mask[w]) {
+            word.fetch_or(mask[w], std::memory_order_relaxed);
+         }
+      }
+   }
+#endif
+
+   // False means key was never inserted. A disabled filter may contain anything.
+   template <typename T>
+   bool may_contain(const T& key) const noexcept {
+      if (blocks.empty()) {
+         return true;
+      }
+      uint64_t mask[8] = {};
+      const Block& block = blocks[_masks(key, mask)];
+      uint64_t missing = 0;
+      for (int w = 0; w < 8; ++w) {
+         missing |= mask[w] & ~block.words[w];
+      }
+      return missing == 0;
+   }
+
+private:
+   std::vector<Block> blocks;
+   int nHashes = 0;
+   float fpRate = 0.0f;
+
+   static uint64_t mix(uint64_t x) noexcept {
+      // splitmix64 finalizer
+      x ^= x >> 30;
+      x *= 0xbf58476d1ce4e5b9ull;
+      x ^= x >> 27;
+      x *= 0x94d049bb133111ebull;
+      x ^= x >> 31;
+      return x;
+   }
+
+   // Fills the per word bit masks of key and returns its block
+   template <typename T>
+   size_t _masks(const T& key, uint64_t* mask) const noexcept {
+      static_assert(std::is_arithmetic<T>::value);
+      const uint64_t h = mix(static_cast<uint64_t>(key));
+      const uint64_t g = mix(h);
+      // Double hashing over the 512 bits of the block
+      const uint32_t a = static_cast<uint32_t>(g);
+      const uint32_t b = static_cast<uint32_t>(g >> 32) | 1u;
+      for (int i = 0; i < nHashes; ++i) {
+         const uint32_t bit = (a + static_cast<uint32_t>(i) * b) & 511u;
+         mask[bit >> 6] |= uint64_t(1) << (bit & 63);
+      }
+      return h & (blocks.size() - 1);
+   }
+};
+
+} // namespace Hashinator
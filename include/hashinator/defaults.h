@@ -30,6 +30,7 @@ constexpr int BUCKET_OVERFLOW = 32;
 constexpr int WARPSIZE = __AMDGCN_WAVEFRONT_SIZE;
 constexpr int BUCKET_OVERFLOW = __AMDGCN_WAVEFRONT_SIZE;
 #else
+constexpr int WARPSIZE = 8;         // lanes of a host virtual warp, see kernels_host.h
 constexpr int BUCKET_OVERFLOW = 32; // to allow cpu only mode
 #ifndef HASHINATOR_CPU_ONLY_MODE
 #error "Warp size not known, please use a CUDA or HIP compiler."
@@ -37,6 +38,9 @@ constexpr int BUCKET_OVERFLOW = 32; // to allow cpu only mode
 #endif
 constexpr int elementsPerWarp = 1;
 constexpr int MAX_BLOCKSIZE = 1024;
+constexpr int PREFETCH_WINDOW = 16; // keys in flight per group in the host batched lookups
+constexpr int PARTITION_REGION_POWER = 15; // smallest bucket region handled by one partition of insert_partitioned
+constexpr int MAX_PARTITION_BITS = 12;     // at most 2^12 partitions in insert_partitioned
 template <typename T>
 using DefaultHashFunction = HashFunctions::Fibonacci<T>;
 } // namespace defaults
@@ -53,4 +57,11 @@ struct Info {
    status err;
 };
 
+// Automatic shrinking done by Hashmap::performCleanupTasks. Disabled while lowWater is 0.
+struct ShrinkPolicy {
+   float lowWater = 0.0f;  // shrink once the load factor drops below this
+   float targetLF = 0.5f;  // load factor right after shrinking
+   int minSizePower = 5;   // never shrink below 2^minSizePower buckets
+};
+
 } // namespace Hashinator
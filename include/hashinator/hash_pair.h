@@ -4,6 +4,7 @@
  *
  * This file defines the following classes:
  *    --Hashinator::hash_pair;
+ *    --Hashinator::KeyOnly;
  *
  *
  * This program is free software; you can redistribute it and/or
@@ -21,6 +22,7 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  * */
 #pragma once
+#include <cstdint>
 #include <stdlib.h>
 #include <type_traits>
 
@@ -74,6 +76,56 @@ struct hash_pair {
    inline bool operator!=(const hash_pair& y) const { return !(*this == y); }
 };
 
+/**
+ * @brief Value type of a map that stores keys only, see Hashinator::Hashset.
+ *
+ * Anything converts to it, so the insertIndex paths and the device kernels that write an index
+ * or a value into the buckets work unchanged, and all values compare equal.
+ */
+struct KeyOnly {
+   KeyOnly() = default;
+
+   template <typename T>
+   HASHINATOR_HOSTDEVICE constexpr KeyOnly(const T&) noexcept {}
+
+   HASHINATOR_HOSTDEVICE
+   constexpr bool operator==(const KeyOnly&) const noexcept { return true; }
+
+   HASHINATOR_HOSTDEVICE
+   constexpr bool operator!=(const KeyOnly&) const noexcept { return false; }
+};
+
+/**
+ * @brief Bucket of a key only map.
+ *
+ * second takes no storage, so the buckets of Hashmap<T, KeyOnly> are bare keys and the map
+ * becomes a set on the Hashmap engine. Writes to second are no-ops, the atomic ones included
+ * through the KeyOnly overloads of the kernels.
+ */
+template <typename T>
+struct hash_pair<T, KeyOnly> {
+
+   T first;                             /**< The key. */
+   [[no_unique_address]] KeyOnly second; /**< Empty, shares the storage of first. */
+
+   HASHINATOR_HOSTDEVICE
+   hash_pair() : first(T()) {}
+
+   HASHINATOR_HOSTDEVICE
+   hash_pair(const T& f, const KeyOnly&) : first(f) {}
+
+   HASHINATOR_HOSTDEVICE
+   inline bool operator==(const hash_pair& y) const { return first == y.first; }
+
+   HASHINATOR_HOSTDEVICE
+   inline bool operator!=(const hash_pair& y) const { return !(*this == y); }
+};
+
+// Checked here so that the host and the device passes both see it: before C++20 the attribute is
+// ignored and every key only bucket carries a padded byte.
+static_assert(sizeof(hash_pair<uint32_t, KeyOnly>) == sizeof(uint32_t),
+              "Key only buckets need [[no_unique_address]], build with C++20");
+
 /**
  * @brief Creates a hash_pair object.
  *
@@ -91,3 +143,11 @@ HASHINATOR_HOSTDEVICE inline hash_pair<T, U> make_pair(T x, U y) {
 }
 
 } // namespace Hashinator
+
+#ifndef HASHINATOR_CPU_ONLY_MODE
+namespace split {
+// Key only buckets have no value to exchange, see Hashinator::KeyOnly
+HASHINATOR_DEVICEONLY
+inline Hashinator::KeyOnly s_atomicExch(Hashinator::KeyOnly*, Hashinator::KeyOnly val) noexcept { return val; }
+} // namespace split
+#endif
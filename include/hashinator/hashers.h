@@ -1,7 +1,8 @@
 /* File:    hashers.h
  * Authors: Kostis Papadakis, Urs Ganse and Markus Battarbee (2023)
  * Description: Defines parallel hashers that insert,retrieve and
- *               delete elements to/from Hahsinator on device
+ *               delete elements to/from Hahsinator on device,
+ *               or on host threads in CPU only mode
  *
  *
  * This program is free software; you can redistribute it and/or
@@ -23,18 +24,130 @@
 #include "../splitvector/gpu_wrappers.h"
 #include "defaults.h"
 #include "hashfunctions.h"
+#include "reducers.h"
 #ifdef __NVCC__
 #include "kernels_NVIDIA.h"
 #endif
 #ifdef __HIP__
 #include "kernels_AMD.h"
 #endif
+#ifdef HASHINATOR_CPU_ONLY_MODE
+#include "../splitvector/split_host_stream.h"
+#include "kernels_host.h"
+#endif
 
 namespace Hashinator {
 namespace Hashers {
 
+#ifdef HASHINATOR_CPU_ONLY_MODE
+#ifdef __cpp_lib_atomic_ref
+/*
+ * Host Hasher with the interface of the device one. Every call runs the matching kernel of
+ * kernels_host.h on the host threads, on the host stream s if one is given (see
+ * split_host_stream.h) or else on the calling thread, returning once it is done.
+ * */
+template <typename KEY_TYPE, typename VAL_TYPE, class HashFunction,
+          KEY_TYPE EMPTYBUCKET = std::numeric_limits<KEY_TYPE>::max(), KEY_TYPE TOMBSTONE = EMPTYBUCKET - 1,
+          int WARP = defaults::WARPSIZE, int elementsPerWarp = 1>
+class Hasher {
+
+   // Make sure we have sane elements per warp
+   static_assert(elementsPerWarp > 0 && elementsPerWarp <= WARP && "Host hasher cannot be instantiated");
+
+public:
+   // Overload with separate input for keys and values.
+   static void insert(KEY_TYPE* keys, VAL_TYPE* vals, hash_pair<KEY_TYPE, VAL_TYPE>* buckets,
+                      Hashinator::Info* info, size_t len, split_gpuStream_t s = 0) {
+      split::host_launch(s, [=]() {
+         info->err = status::success;
+         insert_kernel<KEY_TYPE, VAL_TYPE, EMPTYBUCKET, HashFunction, WARP, elementsPerWarp>(keys, vals, buckets,
+                                                                                            info, len);
+         warnOverflow(info, "Insert");
+      });
+   }
+
+   // Overload with input for keys only, using the index as the value
+   static void insertIndex(KEY_TYPE* keys, hash_pair<KEY_TYPE, VAL_TYPE>* buckets, Hashinator::Info* info,
+                           size_t len, split_gpuStream_t s = 0) {
+      split::host_launch(s, [=]() {
+         info->err = status::success;
+         insert_index_kernel<KEY_TYPE, VAL_TYPE, EMPTYBUCKET, HashFunction, WARP, elementsPerWarp>(keys, buckets,
+                                                                                                  info, len);
+         warnOverflow(info, "InsertIndex");
+      });
+   }
+
+   // Overload with hash_pair<key,val> (k,v) inputs
+   static void insert(hash_pair<KEY_TYPE, VAL_TYPE>* src, hash_pair<KEY_TYPE, VAL_TYPE>* buckets,
+                      Hashinator::Info* info, size_t len, split_gpuStream_t s = 0) {
+      split::host_launch(s, [=]() {
+         info->err = status::success;
+         insert_kernel<KEY_TYPE, VAL_TYPE, EMPTYBUCKET, HashFunction, WARP, elementsPerWarp>(src, buckets, info,
+                                                                                            len);
+         warnOverflow(info, "Insert");
+      });
+   }
+
+   // Retrieve wrapper
+   static void retrieve(KEY_TYPE* keys, VAL_TYPE* vals, hash_pair<KEY_TYPE, VAL_TYPE>* buckets,
+                        Hashinator::Info* info, size_t len, split_gpuStream_t s = 0) {
+      split::host_launch(s, [=]() {
+         retrieve_kernel<KEY_TYPE, VAL_TYPE, EMPTYBUCKET, HashFunction, WARP, elementsPerWarp>(keys, vals, buckets,
+                                                                                              info, len);
+      });
+   }
+
+   static void retrieve(hash_pair<KEY_TYPE, VAL_TYPE>* src, hash_pair<KEY_TYPE, VAL_TYPE>* buckets,
+                        Hashinator::Info* info, size_t len, split_gpuStream_t s = 0) {
+      split::host_launch(s, [=]() {
+         retrieve_kernel<KEY_TYPE, VAL_TYPE, EMPTYBUCKET, HashFunction, WARP, elementsPerWarp>(src, buckets, info,
+                                                                                              len);
+      });
+   }
+
+   // Delete wrapper
+   static void erase(KEY_TYPE* keys, hash_pair<KEY_TYPE, VAL_TYPE>* buckets, Hashinator::Info* info, size_t len,
+                     split_gpuStream_t s = 0) {
+      split::host_launch(s, [=]() {
+         delete_kernel<KEY_TYPE, VAL_TYPE, EMPTYBUCKET, TOMBSTONE, HashFunction, WARP, elementsPerWarp>(
+             keys, buckets, info, len);
+      });
+   }
+
+   // Reset wrapper
+   static void reset(hash_pair<KEY_TYPE, VAL_TYPE>* src, hash_pair<KEY_TYPE, VAL_TYPE>* dst,
+                     Hashinator::Info* info, size_t len, split_gpuStream_t s = 0) {
+      split::host_launch(s, [=]() {
+         reset_to_empty<KEY_TYPE, VAL_TYPE, EMPTYBUCKET, HashFunction, WARP, elementsPerWarp>(src, dst, info, len);
+      });
+   }
+
+   // Reset wrapper for all elements
+   static void reset_all(hash_pair<KEY_TYPE, VAL_TYPE>* dst, Hashinator::Info* info, size_t len,
+                         split_gpuStream_t s = 0) {
+      split::host_launch(s, [=]() { reset_all_to_empty<KEY_TYPE, VAL_TYPE, EMPTYBUCKET>(dst, info, len); });
+   }
+
+private:
+   static void warnOverflow(Hashinator::Info* info, const char* method) {
+#ifndef NDEBUG
+      if (info->err == status::fail) {
+         std::cerr << "***** Hashinator Runtime Warning ********" << std::endl;
+         std::cerr << "Warning: Hashmap completely overflown in Host " << method
+                   << ".\nNot all elements were inserted!\nConsider resizing before calling insert" << std::endl;
+         std::cerr << "******************************" << std::endl;
+      }
+#else
+      (void)info;
+      (void)method;
+#endif
+   }
+};
+#endif
+
+#else
 template <typename KEY_TYPE, typename VAL_TYPE, class HashFunction,
-          KEY_TYPE EMPTYBUCKET = std::numeric_limits<KEY_TYPE>::max(), KEY_TYPE TOMBSTONE = EMPTYBUCKET = 1,
+          KEY_TYPE EMPTYBUCKET = std::numeric_limits<KEY_TYPE>::max(), KEY_TYPE TOMBSTONE = EMPTYBUCKET - 1,
           int WARP = defaults::WARPSIZE, int elementsPerWarp = 1>
 class Hasher {
 
@@ -107,6 +220,30 @@ public:
 #endif
    }
 
+   // Insert with reduction wrapper. Values of keys already present are combined with op.
+   template <class Op>
+   static void insert_reduce(KEY_TYPE* keys, VAL_TYPE* vals, hash_pair<KEY_TYPE, VAL_TYPE>* buckets,
+                             Hashinator::Info* info, size_t len, Op op, size_t nBuckets, split_gpuStream_t s = 0) {
+      info->err = status::success;
+      // fast ceil for positive ints
+      const size_t bucketBlocks = nBuckets / defaults::MAX_BLOCKSIZE + (nBuckets % defaults::MAX_BLOCKSIZE != 0);
+      reset_empty_values<KEY_TYPE, VAL_TYPE, EMPTYBUCKET>
+          <<<bucketBlocks, defaults::MAX_BLOCKSIZE, 0, s>>>(buckets, Op::identity(), nBuckets);
+      const size_t blocks = len / defaults::MAX_BLOCKSIZE + (len % defaults::MAX_BLOCKSIZE != 0);
+      insert_reduce_kernel<KEY_TYPE, VAL_TYPE, EMPTYBUCKET, HashFunction, defaults::WARPSIZE, elementsPerWarp, Op>
+          <<<blocks, defaults::MAX_BLOCKSIZE, 0, s>>>(keys, vals, buckets, info, len, op);
+      SPLIT_CHECK_ERR(split_gpuStreamSynchronize(s));
+#ifndef NDEBUG
+      if (info->err == status::fail) {
+         std::cerr << "***** Hashinator Runtime Warning ********" << std::endl;
+         std::cerr << "Warning: Hashmap completely overflown in Device InsertReduce.\nNot all elements were "
+                      "inserted!\nConsider resizing before calling insert_reduce"
+                   << std::endl;
+         std::cerr << "******************************" << std::endl;
+      }
+#endif
+   }
+
    // Retrieve wrapper
    static void retrieve(KEY_TYPE* keys, VAL_TYPE* vals, hash_pair<KEY_TYPE, VAL_TYPE>* buckets,
                         Hashinator::Info* info, size_t len, split_gpuStream_t s = 0) {
@@ -170,6 +307,7 @@ private:
       return;
    }
 };
+#endif
 
 } // namespace Hashers
 } // namespace Hashinator
@@ -28,18 +28,28 @@
 #include "../common.h"
 #include "../splitvector/gpu_wrappers.h"
 #include "../splitvector/split_allocators.h"
+#include "../splitvector/split_host_tools.h"
 #include "../splitvector/splitvec.h"
+#include "blocked_bloom.h"
 #include "defaults.h"
 #include "hash_pair.h"
 #include "hashfunctions.h"
+#include "reducers.h"
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cmath>
 #include <limits>
+#include <memory>
+#include <optional>
 #include <stdexcept>
+#ifdef __cpp_impl_coroutine
+#include "lookup_scheduler.h"
+#endif
 #ifndef HASHINATOR_CPU_ONLY_MODE
 #include "../splitvector/split_tools.h"
-#include "hashers.h"
 #endif
+#include "hashers.h"
 
 namespace Hashinator {
 
@@ -52,8 +62,14 @@ using DefaultMetaAllocator = split::split_unified_allocator<T>;
 #else
 template <typename T>
 using DefaultMetaAllocator = split::split_host_allocator<T>;
+#ifdef __cpp_lib_atomic_ref
+#define DefaultHasher                                                                                                  \
+   Hashers::Hasher<KEY_TYPE, VAL_TYPE, HashFunction, EMPTYBUCKET, TOMBSTONE, defaults::WARPSIZE,                       \
+                   defaults::elementsPerWarp>
+#else
 #define DefaultHasher void
 #endif
+#endif
 
 using MapInfo = Hashinator::Info;
 template <typename KEY_TYPE, typename VAL_TYPE, KEY_TYPE EMPTYBUCKET = std::numeric_limits<KEY_TYPE>::max(),
@@ -61,16 +77,27 @@ template <typename KEY_TYPE, typename VAL_TYPE, KEY_TYPE EMPTYBUCKET = std::nume
           class DeviceHasher = DefaultHasher, class Meta_Allocator = DefaultMetaAllocator<MapInfo>>
 class Hashmap {
 
+   // Buckets are allocated with Meta_Allocator rebound to the bucket type, so a host allocator such as
+   // split::split_hugepage_allocator selects the storage of the whole table.
+   using bucket_allocator =
+       typename std::allocator_traits<Meta_Allocator>::template rebind_alloc<hash_pair<KEY_TYPE, VAL_TYPE>>;
+   using bucket_vector = split::SplitVector<hash_pair<KEY_TYPE, VAL_TYPE>, bucket_allocator>;
+
 private:
    // CUDA device handle
    Hashmap* device_map;
-   split::SplitVector<hash_pair<KEY_TYPE, VAL_TYPE>>* device_buckets;
+   bucket_vector* device_buckets;
    //~CUDA device handle
 
    // Host members
-   split::SplitVector<hash_pair<KEY_TYPE, VAL_TYPE>> buckets;
+   bucket_vector buckets;
    Meta_Allocator _metaAllocator; // Allocator used to allocate and deallocate memory for metadata
    MapInfo* _mapInfo;
+   ShrinkPolicy _shrinkPolicy; // See set_shrink_policy
+#ifdef HASHINATOR_CPU_ONLY_MODE
+   std::vector<uint64_t> _occupancy; // Optional occupancy bitmap, see track_occupancy
+   BlockedBloomFilter _bloom;        // Optional filter in front of lookups, see enable_bloom_filter
+#endif
    //~Host members
 
    // Wrapper over available hash functions
@@ -87,8 +114,8 @@ private:
    void preallocate_device_handles() {
 #ifndef HASHINATOR_CPU_ONLY_MODE
       SPLIT_CHECK_ERR(split_gpuMalloc((void**)&device_map, sizeof(Hashmap)));
-      device_buckets = reinterpret_cast<split::SplitVector<hash_pair<KEY_TYPE, VAL_TYPE>>*>(
-          reinterpret_cast<char*>(device_map) + offsetof(Hashmap, buckets));
+      device_buckets =
+          reinterpret_cast<bucket_vector*>(reinterpret_cast<char*>(device_map) + offsetof(Hashmap, buckets));
 #endif
    }
 
@@ -107,13 +134,183 @@ private:
    HASHINATOR_HOSTDEVICE
    inline void set_status(status code) noexcept { _mapInfo->err = code; }
 
+   // Size power the shrink policy asks for, the current one if the map should not shrink
+   int _shrink_size_power() const noexcept {
+      const int current = _mapInfo->sizePower;
+      if (_shrinkPolicy.lowWater <= 0.0f || current <= _shrinkPolicy.minSizePower ||
+          load_factor() >= _shrinkPolicy.lowWater) {
+         return current;
+      }
+      const double needed = std::max(double(_mapInfo->fill) / _shrinkPolicy.targetLF, 1.0);
+      const int power = std::max(static_cast<int>(std::ceil(std::log2(needed))), _shrinkPolicy.minSizePower);
+      return std::min(power, current);
+   }
+
+   // First live bucket at or after index, buckets.size() if there is none
+   size_t _next_live(size_t index) const noexcept {
+      const size_t bsize = buckets.size();
+#ifdef HASHINATOR_CPU_ONLY_MODE
+      if (!_occupancy.empty()) {
+         if (index >= bsize) {
+            return bsize;
+         }
+         size_t word = index / 64;
+         uint64_t bits = _occupancy[word] & (~uint64_t(0) << (index % 64));
+         while (bits == 0) {
+            if (++word == _occupancy.size()) {
+               return bsize;
+            }
+            bits = _occupancy[word];
+         }
+         return word * 64 + __builtin_ctzll(bits);
+      }
+#endif
+      while (index < bsize && (buckets[index].first == EMPTYBUCKET || buckets[index].first == TOMBSTONE)) {
+         index++;
+      }
+      return index;
+   }
+
+   // Occupancy bitmap maintenance, no-ops unless track_occupancy is on
+   void _occupancy_set(size_t index) noexcept {
+#ifdef HASHINATOR_CPU_ONLY_MODE
+      if (!_occupancy.empty()) {
+         _occupancy[index / 64] |= uint64_t(1) << (index % 64);
+      }
+#else
+      (void)index;
+#endif
+   }
+
+   void _occupancy_clear(size_t index) noexcept {
+#ifdef HASHINATOR_CPU_ONLY_MODE
+      if (!_occupancy.empty()) {
+         _occupancy[index / 64] &= ~(uint64_t(1) << (index % 64));
+      }
+#else
+      (void)index;
+#endif
+   }
+
+#if defined(HASHINATOR_CPU_ONLY_MODE) && defined(__cpp_lib_atomic_ref)
+   void _occupancy_set_atomic(size_t index) noexcept {
+      if (!_occupancy.empty()) {
+         std::atomic_ref<uint64_t>(_occupancy[index / 64])
+             .fetch_or(uint64_t(1) << (index % 64), std::memory_order_relaxed);
+      }
+   }
+
+   void _occupancy_clear_atomic(size_t index) noexcept {
+      if (!_occupancy.empty()) {
+         std::atomic_ref<uint64_t>(_occupancy[index / 64])
+             .fetch_and(~(uint64_t(1) << (index % 64)), std::memory_order_relaxed);
+      }
+   }
+#endif
+
+#ifdef __cpp_lib_atomic_ref
+   // Value accesses of the concurrent host operations. Key only buckets (see KeyOnly) have no value
+   // and an atomic_ref to their second would write over the key.
+   static void _publish_value(VAL_TYPE& target, const VAL_TYPE& value) noexcept {
+      if constexpr (!std::is_same<VAL_TYPE, KeyOnly>::value) {
+         std::atomic_ref<VAL_TYPE>(target).store(value, std::memory_order_release);
+      }
+   }
+
+   static VAL_TYPE _acquire_value(const VAL_TYPE& source) noexcept {
+      if constexpr (std::is_same<VAL_TYPE, KeyOnly>::value) {
+         return source;
+      } else {
+         return std::atomic_ref<VAL_TYPE>(const_cast<VAL_TYPE&>(source)).load(std::memory_order_acquire);
+      }
+   }
+#endif
+
+   // Overwrites every bucket with an empty one from all host threads. Values are reset too, as
+   // operator[] hands out the value of a fresh bucket and insert_reduce leaves identities there.
+   void _reset_buckets() {
+      const hash_pair<KEY_TYPE, VAL_TYPE> empty(EMPTYBUCKET, VAL_TYPE());
+      hash_pair<KEY_TYPE, VAL_TYPE>* data = buckets.data();
+      split::tools::parallel_for(
+          buckets.size(),
+          [data, &empty](size_t begin, size_t end, size_t) { std::fill(data + begin, data + end, empty); },
+          1ul << 16);
+   }
+
+   // Bloom filter maintenance, no-ops unless enable_bloom_filter is on
+   void _bloom_add(const KEY_TYPE& key) noexcept {
+#ifdef HASHINATOR_CPU_ONLY_MODE
+      if (_bloom.enabled()) {
+         _bloom.insert(key);
+      }
+#else
+      (void)key;
+#endif
+   }
+
+   bool _bloom_may_contain(const KEY_TYPE& key) const noexcept {
+#ifdef HASHINATOR_CPU_ONLY_MODE
+      return _bloom.may_contain(key);
+#else
+      (void)key;
+      return true;
+#endif
+   }
+
+   // Resizes the filter to the buckets and refills it, which also forgets erased keys
+   void _bloom_rebuild() {
+#ifdef HASHINATOR_CPU_ONLY_MODE
+      if (!_bloom.enabled()) {
+         return;
+      }
+      _bloom.reset(buckets.size(), _bloom.false_positive_rate());
+#ifdef __cpp_lib_atomic_ref
+      _for_each_live([&](size_t i, size_t) { _bloom.insert_concurrent(buckets[i].first); });
+#else
+      for (size_t i = _next_live(0); i < buckets.size(); i = _next_live(i + 1)) {
+         _bloom.insert(buckets[i].first);
+      }
+#endif
+#endif
+   }
+
+   // Recomputes the bitmap from the buckets after bulk changes
+   void _occupancy_rebuild() {
+#ifdef HASHINATOR_CPU_ONLY_MODE
+      if (_occupancy.empty()) {
+         return;
+      }
+      const size_t bsize = buckets.size();
+      _occupancy.assign((bsize + 63) / 64, 0);
+      split::tools::parallel_for(
+          _occupancy.size(),
+          [&](size_t firstWord, size_t lastWord, size_t) {
+             for (size_t word = firstWord; word < lastWord; ++word) {
+                _occupancy[word] = _scan_live(word);
+             }
+          },
+          (1ul << 14) / 64);
+#endif
+   }
+
+   // Live mask of the buckets [64 * word, 64 * word + 64) read from the buckets themselves
+   uint64_t _scan_live(size_t word) const noexcept {
+      const size_t base = word * 64;
+      const size_t n = std::min(size_t(64), buckets.size() - base);
+      const hash_pair<KEY_TYPE, VAL_TYPE>* b = &buckets[base];
+      uint64_t live = 0;
+      for (size_t j = 0; j < n; ++j) {
+         live |= uint64_t(b[j].first != EMPTYBUCKET && b[j].first != TOMBSTONE) << j;
+      }
+      return live;
+   }
+
 public:
    Hashmap() {
       preallocate_device_handles();
       _mapInfo = _metaAllocator.allocate(1);
       *_mapInfo = MapInfo(5);
-      buckets = split::SplitVector<hash_pair<KEY_TYPE, VAL_TYPE>>(
-          1 << _mapInfo->sizePower, hash_pair<KEY_TYPE, VAL_TYPE>(EMPTYBUCKET, VAL_TYPE()));
+      buckets = bucket_vector(1 << _mapInfo->sizePower, hash_pair<KEY_TYPE, VAL_TYPE>(EMPTYBUCKET, VAL_TYPE()));
 #ifndef HASHINATOR_CPU_ONLY_MODE
       SPLIT_CHECK_ERR(split_gpuMemcpy(device_map, this, sizeof(Hashmap), split_gpuMemcpyHostToDevice));
 #endif
@@ -123,40 +320,51 @@ public:
       preallocate_device_handles();
       _mapInfo = _metaAllocator.allocate(1);
       *_mapInfo = MapInfo(sizepower);
-      buckets = split::SplitVector<hash_pair<KEY_TYPE, VAL_TYPE>>(
-          1 << _mapInfo->sizePower, hash_pair<KEY_TYPE, VAL_TYPE>(EMPTYBUCKET, VAL_TYPE()));
+      buckets = bucket_vector(1 << _mapInfo->sizePower, hash_pair<KEY_TYPE, VAL_TYPE>(EMPTYBUCKET, VAL_TYPE()));
 #ifndef HASHINATOR_CPU_ONLY_MODE
       SPLIT_CHECK_ERR(split_gpuMemcpy(device_map, this, sizeof(Hashmap), split_gpuMemcpyHostToDevice));
 #endif
    };
 
-   Hashmap(const Hashmap<KEY_TYPE, VAL_TYPE>& other) {
+   Hashmap(const Hashmap& other) {
       preallocate_device_handles();
       _mapInfo = _metaAllocator.allocate(1);
       *_mapInfo = *(other._mapInfo);
       buckets = other.buckets;
-#ifndef HASHINATOR_CPU_ONLY_MODE
+      _shrinkPolicy = other._shrinkPolicy;
+#ifdef HASHINATOR_CPU_ONLY_MODE
+      _occupancy = other._occupancy;
+      _bloom = other._bloom;
+#else
       SPLIT_CHECK_ERR(split_gpuMemcpy(device_map, this, sizeof(Hashmap), split_gpuMemcpyHostToDevice));
 #endif
    };
 
-   Hashmap(Hashmap<KEY_TYPE, VAL_TYPE>&& other) {
+   Hashmap(Hashmap&& other) {
       preallocate_device_handles();
       _mapInfo = other._mapInfo;
       other._mapInfo = nullptr;
       buckets = std::move(other.buckets);
-#ifndef HASHINATOR_CPU_ONLY_MODE
+      _shrinkPolicy = other._shrinkPolicy;
+#ifdef HASHINATOR_CPU_ONLY_MODE
+      _occupancy = std::move(other._occupancy);
+      _bloom = std::move(other._bloom);
+#else
       SPLIT_CHECK_ERR(split_gpuMemcpy(device_map, this, sizeof(Hashmap), split_gpuMemcpyHostToDevice));
 #endif
    };
 
-   Hashmap& operator=(const Hashmap<KEY_TYPE, VAL_TYPE>& other) {
+   Hashmap& operator=(const Hashmap& other) {
       if (this == &other) {
          return *this;
       }
       *_mapInfo = *(other._mapInfo);
       buckets = other.buckets;
-#ifndef HASHINATOR_CPU_ONLY_MODE
+      _shrinkPolicy = other._shrinkPolicy;
+#ifdef HASHINATOR_CPU_ONLY_MODE
+      _occupancy = other._occupancy;
+      _bloom = other._bloom;
+#else
       SPLIT_CHECK_ERR(split_gpuMemcpy(device_map, this, sizeof(Hashmap), split_gpuMemcpyHostToDevice));
 #endif
       return *this;
@@ -164,7 +372,7 @@ public:
 
 #ifndef HASHINATOR_CPU_ONLY_MODE
    /** Copy assign but using a provided stream */
-   void overwrite(const Hashmap<KEY_TYPE, VAL_TYPE>& other, split_gpuStream_t stream = 0) {
+   void overwrite(const Hashmap& other, split_gpuStream_t stream = 0) {
       if (this == &other) {
          return;
       }
@@ -176,7 +384,7 @@ public:
    }
 #endif
 
-   Hashmap& operator=(Hashmap<KEY_TYPE, VAL_TYPE>&& other) {
+   Hashmap& operator=(Hashmap&& other) {
       if (this == &other) {
          return *this;
       }
@@ -184,7 +392,11 @@ public:
       _mapInfo = other._mapInfo;
       other._mapInfo = nullptr;
       buckets = std::move(other.buckets);
-#ifndef HASHINATOR_CPU_ONLY_MODE
+      _shrinkPolicy = other._shrinkPolicy;
+#ifdef HASHINATOR_CPU_ONLY_MODE
+      _occupancy = std::move(other._occupancy);
+      _bloom = std::move(other._bloom);
+#else
       SPLIT_CHECK_ERR(split_gpuMemcpy(device_map, this, sizeof(Hashmap), split_gpuMemcpyHostToDevice));
 #endif
       return *this;
@@ -239,8 +451,7 @@ public:
       if (newSizePower > 32) {
          throw std::out_of_range("Hashmap ran into rehashing catastrophe and exceeded 32bit buckets.");
       }
-      split::SplitVector<hash_pair<KEY_TYPE, VAL_TYPE>> newBuckets(
-          1 << newSizePower, hash_pair<KEY_TYPE, VAL_TYPE>(EMPTYBUCKET, VAL_TYPE()));
+      bucket_vector newBuckets(1 << newSizePower, hash_pair<KEY_TYPE, VAL_TYPE>(EMPTYBUCKET, VAL_TYPE()));
       _mapInfo->sizePower = newSizePower;
       int bitMask = (1 << _mapInfo->sizePower) - 1; // For efficient modulo of the array size
 
@@ -275,6 +486,8 @@ public:
       buckets = newBuckets;
       _mapInfo->currentMaxBucketOverflow = Hashinator::defaults::BUCKET_OVERFLOW;
       _mapInfo->tombstoneCounter = 0;
+      _occupancy_rebuild();
+      _bloom_rebuild();
 #ifndef HASHINATOR_CPU_ONLY_MODE
       SPLIT_CHECK_ERR(split_gpuMemcpy(device_map, this, sizeof(Hashmap), split_gpuMemcpyHostToDevice));
 #endif
@@ -324,8 +537,7 @@ public:
          // DeviceHasher::reset_all(buckets.data(),_mapInfo, buckets.size(), s);
       } else {
          // Need new buckets
-         buckets = std::move(split::SplitVector<hash_pair<KEY_TYPE, VAL_TYPE>>(
-             1 << newSizePower, hash_pair<KEY_TYPE, VAL_TYPE>(EMPTYBUCKET, VAL_TYPE())));
+         buckets = std::move(bucket_vector(1 << newSizePower, hash_pair<KEY_TYPE, VAL_TYPE>(EMPTYBUCKET, VAL_TYPE())));
          SPLIT_CHECK_ERR(split_gpuMemcpyAsync(device_map, this, sizeof(Hashmap), split_gpuMemcpyHostToDevice, s));
          optimizeGPU(s);
       }
@@ -355,9 +567,13 @@ public:
          }
 
          if (candidate.first == EMPTYBUCKET) {
-            // Found an empty bucket, assign and return that.
+            // Found an empty bucket, assign and return that. Its value may be a leftover identity of
+            // insert_reduce, so it is value initialised.
             candidate.first = key;
+            candidate.second = VAL_TYPE();
             _mapInfo->fill++;
+            _occupancy_set((hashIndex + i) & bitMask);
+            _bloom_add(key);
             return candidate.second;
          }
 
@@ -367,6 +583,8 @@ public:
             // We remove this Tombstone
             candidate.first = key;
             _mapInfo->tombstoneCounter--;
+            _occupancy_set((hashIndex + i) & bitMask);
+            _bloom_add(key);
 
             // We look ahead in case candidate was already in the hashmap
             // If we find it then we swap the duplicate with empty and do not increment fill
@@ -377,6 +595,7 @@ public:
                if (duplicate.first == candidate.first) {
                   alreadyExists = true;
                   candidate.second = duplicate.second;
+                  _occupancy_clear((hashIndex + j) & bitMask);
                   if (buckets[(hashIndex + j + 1) & bitMask].first == EMPTYBUCKET ||
                       j + 1 >= _mapInfo->currentMaxBucketOverflow) {
                      duplicate.first = EMPTYBUCKET;
@@ -388,6 +607,8 @@ public:
                }
             }
             if (!alreadyExists) {
+               // The tombstone still holds the value of the erased key
+               candidate.second = VAL_TYPE();
                _mapInfo->fill++;
             }
             return candidate.second;
@@ -430,6 +651,32 @@ public:
       throw std::out_of_range("Element not found in Hashmap.at");
    }
 
+   // Probes for key starting at bucket hashIndex. Returns the index of the matching bucket
+   // or buckets.size() if the key is not in the map. Used by the batched host lookups.
+   size_t _find_index(const KEY_TYPE& key, size_t hashIndex) const noexcept {
+      if (!_bloom_may_contain(key)) {
+         return buckets.size();
+      }
+      return _probe_index(key, hashIndex);
+   }
+
+   // Same as _find_index without asking the bloom filter, for keys it may not hold yet
+   size_t _probe_index(const KEY_TYPE& key, size_t hashIndex) const noexcept {
+      const size_t bsize = buckets.size();
+      const size_t bitMask = bsize - 1; // For efficient modulo of the array size
+      for (size_t i = 0; i < bsize; i++) {
+         const size_t index = (hashIndex + i) & bitMask;
+         const KEY_TYPE candidate = buckets[index].first;
+         if (candidate == key) {
+            return index;
+         }
+         if (candidate == EMPTYBUCKET) {
+            return bsize;
+         }
+      }
+      return bsize;
+   }
+
    //---------------------------------------
 
    HASHINATOR_HOSTDEVICE
@@ -484,9 +731,12 @@ public:
    }
 
 #ifdef HASHINATOR_CPU_ONLY_MODE
+   // Empties the buckets in place, keeping their allocation and size
    void clear() {
-      buckets = split::SplitVector<hash_pair<KEY_TYPE, VAL_TYPE>>(1 << _mapInfo->sizePower, {EMPTYBUCKET, VAL_TYPE()});
+      _reset_buckets();
       *_mapInfo = MapInfo(_mapInfo->sizePower);
+      _occupancy_rebuild();
+      _bloom_rebuild();
       return;
    }
 #else
@@ -494,8 +744,7 @@ public:
    void clear(targets t = targets::host, split_gpuStream_t s = 0, size_t len = 0) {
       switch (t) {
       case targets::host:
-         buckets =
-             split::SplitVector<hash_pair<KEY_TYPE, VAL_TYPE>>(1 << _mapInfo->sizePower, {EMPTYBUCKET, VAL_TYPE()});
+         _reset_buckets();
          *_mapInfo = MapInfo(_mapInfo->sizePower);
          break;
 
@@ -621,19 +870,45 @@ public:
       return (float)_mapInfo->tombstoneCounter / (float)buckets.size();
    }
 
-   void swap(Hashmap<KEY_TYPE, VAL_TYPE>& other) noexcept {
+   void swap(Hashmap& other) noexcept {
       buckets.swap(other.buckets);
       std::swap(_mapInfo, other._mapInfo);
       std::swap(device_map, other.device_map);
       std::swap(device_buckets, other.device_buckets);
+      std::swap(_shrinkPolicy, other._shrinkPolicy);
+#ifdef HASHINATOR_CPU_ONLY_MODE
+      _occupancy.swap(other._occupancy);
+      std::swap(_bloom, other._bloom);
+#endif
+   }
+
+   /*
+    * Lets performCleanupTasks shrink the map once its load factor drops below lowWater, down to the
+    * smallest size that holds the current elements at targetLF but never below 2^minSizePower buckets.
+    * targetLF has to be more than twice lowWater, so that a freshly shrunk map is far from shrinking
+    * again and a few insertions do not immediately make it grow back. lowWater = 0 disables shrinking.
+    */
+   void set_shrink_policy(float lowWater, float targetLF = 0.5, int minSizePower = 5) {
+      if (lowWater < 0.0f || targetLF > 1.0f || (lowWater > 0.0f && 2.0f * lowWater >= targetLF)) {
+         throw std::invalid_argument("Shrink policy needs 0 <= 2 * lowWater < targetLF <= 1");
+      }
+      _shrinkPolicy = ShrinkPolicy{lowWater, targetLF, std::max(minSizePower, 1)};
    }
 
+   ShrinkPolicy shrink_policy() const noexcept { return _shrinkPolicy; }
+
 #ifdef HASHINATOR_CPU_ONLY_MODE
    // Try to get the overflow back to the original one
    void performCleanupTasks() {
       while (_mapInfo->currentMaxBucketOverflow > Hashinator::defaults::BUCKET_OVERFLOW) {
          rehash(_mapInfo->sizePower + 1);
       }
+      // Shrinking rehashes so it gets rid of tombstones as well
+      const int shrunkSizePower = _shrink_size_power();
+      if (shrunkSizePower < _mapInfo->sizePower) {
+         rehash(shrunkSizePower);
+         return;
+      }
       // When operating in CPU only mode we rehash to get rid of tombstones
       if (tombstone_ratio() > 0.25) {
          rehash(_mapInfo->sizePower);
@@ -643,7 +918,10 @@ public:
    // Try to get the overflow back to the original one
    template <bool prefetches = true>
    void performCleanupTasks(split_gpuStream_t s = 0) {
-      if (tombstone_ratio() > 0.025) {
+      const int shrunkSizePower = _shrink_size_power();
+      if (shrunkSizePower < _mapInfo->sizePower) {
+         device_rehash<prefetches>(shrunkSizePower, s);
+      } else if (tombstone_ratio() > 0.025) {
          clean_tombstones<prefetches>(s);
       }
       while (_mapInfo->currentMaxBucketOverflow > Hashinator::defaults::BUCKET_OVERFLOW) {
@@ -673,20 +951,14 @@ public:
 
    // Iterator type. Iterates through all non-empty buckets.
    class iterator {
-      Hashmap<KEY_TYPE, VAL_TYPE>* hashtable;
+      Hashmap* hashtable;
       size_t index;
 
    public:
-      iterator(Hashmap<KEY_TYPE, VAL_TYPE>& hashtable, size_t index) : hashtable(&hashtable), index(index) {}
+      iterator(Hashmap& hashtable, size_t index) : hashtable(&hashtable), index(index) {}
 
       iterator& operator++() {
-         index++;
-         while (index < hashtable->buckets.size()) {
-            if (hashtable->buckets[index].first != EMPTYBUCKET && hashtable->buckets[index].first != TOMBSTONE) {
-               break;
-            }
-            index++;
-         }
+         index = hashtable->_next_live(index + 1);
          return *this;
       }
 
@@ -708,20 +980,14 @@ public:
 
    // Const iterator.
    class const_iterator {
-      const Hashmap<KEY_TYPE, VAL_TYPE>* hashtable;
+      const Hashmap* hashtable;
       size_t index;
 
    public:
-      explicit const_iterator(const Hashmap<KEY_TYPE, VAL_TYPE>& hashtable, size_t index)
+      explicit const_iterator(const Hashmap& hashtable, size_t index)
           : hashtable(&hashtable), index(index) {}
       const_iterator& operator++() {
-         index++;
-         while (index < hashtable->buckets.size()) {
-            if (hashtable->buckets[index].first != EMPTYBUCKET && hashtable->buckets[index].first != TOMBSTONE) {
-               break;
-            }
-            index++;
-         }
+         index = hashtable->_next_live(index + 1);
          return *this;
       }
       const_iterator operator++(int) { // Postfix version
@@ -742,6 +1008,9 @@ public:
 
    // Element access by iterator
    const const_iterator find(KEY_TYPE key) const {
+      if (!_bloom_may_contain(key)) {
+         return end();
+      }
       int bitMask = (1 << _mapInfo->sizePower) - 1; // For efficient modulo of the array size
       auto hashIndex = hash(key);
 
@@ -771,6 +1040,9 @@ public:
 
    iterator find(KEY_TYPE key) {
       performCleanupTasks();
+      if (!_bloom_may_contain(key)) {
+         return end();
+      }
       int bitMask = (1 << _mapInfo->sizePower) - 1; // For efficient modulo of the array size
       auto hashIndex = hash(key);
 
@@ -798,28 +1070,42 @@ public:
       return end();
    }
 
-   iterator begin() {
-      for (size_t i = 0; i < buckets.size(); i++) {
-         if (buckets[i].first != EMPTYBUCKET && buckets[i].first != TOMBSTONE) {
-            return iterator(*this, i);
-         }
-      }
-      return end();
-   }
+   iterator begin() { return iterator(*this, _next_live(0)); }
 
-   const_iterator begin() const {
-      for (size_t i = 0; i < buckets.size(); i++) {
-         if (buckets[i].first != EMPTYBUCKET && buckets[i].first != TOMBSTONE) {
-            return const_iterator(*this, i);
-         }
-      }
-      return end();
-   }
+   const_iterator begin() const { return const_iterator(*this, _next_live(0)); }
 
    iterator end() { return iterator(*this, buckets.size()); }
 
    const_iterator end() const { return const_iterator(*this, buckets.size()); }
 
+#ifdef __cpp_impl_coroutine
+   // Awaitable returned by async_find. Suspending prefetches the home bucket of the key and
+   // requeues the task in its LookupScheduler; the probing happens once the task is resumed.
+   class find_awaiter {
+      Hashmap* hashtable;
+      KEY_TYPE key;
+      size_t home;
+
+   public:
+      find_awaiter(Hashmap& hashtable, const KEY_TYPE& key)
+          : hashtable(&hashtable), key(key), home(0) {}
+      bool await_ready() const noexcept { return false; }
+      void await_suspend(LookupTask::handle_type h) noexcept {
+         home = hashtable->hash(key) & (hashtable->buckets.size() - 1);
+         prefetch(&hashtable->buckets[home]);
+         h.promise().scheduler->schedule(h);
+      }
+      iterator await_resume() const noexcept {
+         const size_t index = hashtable->_find_index(key, home);
+         return iterator(*hashtable, index);
+      }
+   };
+
+   // Element access by iterator from within a LookupTask: co_await hmap.async_find(key).
+   // Unlike find(), no cleanup tasks run here so the map must not be resized while lookups are pending.
+   find_awaiter async_find(const KEY_TYPE& key) { return find_awaiter(*this, key); }
+#endif
+
    // Remove one element from the hash table.
    iterator erase(iterator keyPos) {
       size_t index = keyPos.getIndex();
@@ -827,6 +1113,7 @@ public:
          buckets[index].first = TOMBSTONE;
          _mapInfo->fill--;
          _mapInfo->tombstoneCounter++;
+         _occupancy_clear(index);
       }
       // return the next valid bucket member
       ++keyPos;
@@ -851,6 +1138,108 @@ public:
       }
    }
 
+#ifdef __cpp_lib_atomic_ref
+   /**
+    * Lock-free host point operations. These follow the device path (insert_element/warpErase):
+    * keys are claimed with a CAS on hash_pair::first and values are published with an exchange on
+    * hash_pair::second, so many host threads can operate on the same map concurrently.
+    * The table is never resized from here. If a key cannot be placed within the current overflow
+    * window concurrent_insert returns status::fail and leaves the map untouched; the caller then
+    * has to resize (or call performCleanupTasks) from a single thread and retry.
+    * Mixing these with the serial host API while other threads are active is not supported.
+    */
+   status concurrent_insert(const KEY_TYPE& key, const VAL_TYPE& value) noexcept {
+      const size_t bitMask = (1ul << _mapInfo->sizePower) - 1; // For efficient modulo of the array size
+      const size_t bsize = buckets.size();
+      const size_t maxOverflow =
+          std::min(std::atomic_ref<size_t>(_mapInfo->currentMaxBucketOverflow).load(std::memory_order_relaxed), bsize);
+      const auto hashIndex = hash(key);
+
+      for (size_t i = 0; i < bsize; i++) {
+         hash_pair<KEY_TYPE, VAL_TYPE>& candidate = buckets[(hashIndex + i) & bitMask];
+         std::atomic_ref<KEY_TYPE> slot(candidate.first);
+         KEY_TYPE old = slot.load(std::memory_order_acquire);
+
+         // Key exists so we overwrite it. Fill stays the same
+         if (old == key) {
+            _publish_value(candidate.second, value);
+            return status::success;
+         }
+
+         if (old == EMPTYBUCKET) {
+            // Every key lives before the first empty bucket of its probing chain, so if we get here
+            // past the overflow window the key is new and the table needs to grow.
+            if (i >= maxOverflow) {
+               return status::fail;
+            }
+            if (slot.compare_exchange_strong(old, key, std::memory_order_acq_rel)) {
+               _publish_value(candidate.second, value);
+               std::atomic_ref<size_t>(_mapInfo->fill).fetch_add(1, std::memory_order_relaxed);
+               _occupancy_set_atomic((hashIndex + i) & bitMask);
+               if (_bloom.enabled()) {
+                  _bloom.insert_concurrent(key);
+               }
+               return status::success;
+            }
+            // Parallel insertion already added this key.
+            if (old == key) {
+               _publish_value(candidate.second, value);
+               return status::success;
+            }
+            // else some other key was written here so we keep probing.
+         }
+      }
+      return status::fail;
+   }
+
+   // Lock-free host lookup. Returns false if key is not in the map, otherwise its value is written to value.
+   bool concurrent_find(const KEY_TYPE& key, VAL_TYPE& value) const noexcept {
+      const size_t bitMask = (1ul << _mapInfo->sizePower) - 1; // For efficient modulo of the array size
+      const size_t bsize = buckets.size();
+      const auto hashIndex = hash(key);
+
+      for (size_t i = 0; i < bsize; i++) {
+         const hash_pair<KEY_TYPE, VAL_TYPE>& candidate = buckets[(hashIndex + i) & bitMask];
+         const KEY_TYPE current =
+             std::atomic_ref<KEY_TYPE>(const_cast<KEY_TYPE&>(candidate.first)).load(std::memory_order_acquire);
+         if (current == key) {
+            value = _acquire_value(candidate.second);
+            return true;
+         }
+         if (current == EMPTYBUCKET) {
+            return false;
+         }
+      }
+      return false;
+   }
+
+   // Lock-free host removal with tombstones. Returns the number of erased elements (0 or 1).
+   size_t concurrent_erase(const KEY_TYPE& key) noexcept {
+      const size_t bitMask = (1ul << _mapInfo->sizePower) - 1; // For efficient modulo of the array size
+      const size_t bsize = buckets.size();
+      const auto hashIndex = hash(key);
+
+      for (size_t i = 0; i < bsize; i++) {
+         std::atomic_ref<KEY_TYPE> slot(buckets[(hashIndex + i) & bitMask].first);
+         KEY_TYPE current = slot.load(std::memory_order_acquire);
+         if (current == key) {
+            // Only one of the racing erasers gets to account for the removal
+            if (slot.compare_exchange_strong(current, TOMBSTONE, std::memory_order_acq_rel)) {
+               std::atomic_ref<size_t>(_mapInfo->fill).fetch_sub(1, std::memory_order_relaxed);
+               std::atomic_ref<size_t>(_mapInfo->tombstoneCounter).fetch_add(1, std::memory_order_relaxed);
+               _occupancy_clear_atomic((hashIndex + i) & bitMask);
+               return 1;
+            }
+            return 0;
+         }
+         if (current == EMPTYBUCKET) {
+            return 0;
+         }
+      }
+      return 0;
+   }
+#endif
+
 #ifndef HASHINATOR_CPU_ONLY_MODE
    template <bool skipOverWrites = false>
    HASHINATOR_DEVICEONLY void warpInsert(const KEY_TYPE& candidateKey, const VAL_TYPE& candidateVal,
@@ -1336,6 +1725,33 @@ public:
       return;
    }
 
+   /*
+    * Uses Hasher's insert_reduce to upsert all elements: keys already in the map get op(old, val) and
+    * new keys start from op.identity(). op is any reducer as described in reducers.h.
+    * As insert() the map is grown upfront so that fill + len elements fit at targetLF. The reductions
+    * that already landed cannot be told apart from the elements that did not, so the latter are not
+    * retried: if any element still did not fit, peek_status() returns status::fail.
+    */
+   template <bool prefetches = true, typename Op>
+   void insert_reduce(KEY_TYPE* keys, VAL_TYPE* vals, size_t len, Op op, float targetLF = 0.5,
+                      split_gpuStream_t s = 0) {
+      if (len == 0) {
+         set_status(status::success);
+         return;
+      }
+      if constexpr (prefetches) {
+         buckets.optimizeGPU(s);
+      }
+      int64_t neededPowerSize = std::ceil(std::log2((_mapInfo->fill + len) * (1.0 / targetLF)));
+      if (neededPowerSize > _mapInfo->sizePower) {
+         resize(neededPowerSize, targets::device, s);
+      }
+      DeviceHasher::insert_reduce(keys, vals, buckets.data(), _mapInfo, len, op, buckets.size(), s);
+      // The Hasher synchronized s, so the outcome of the kernel is final here
+      set_status(_mapInfo->err == status::fail ? status::fail : status::success);
+      return;
+   }
+
    // Uses Hasher's insert_index_kernel to insert all elements, with the index as the value
    template <bool prefetches = true>
    void insertIndex(KEY_TYPE* keys, size_t len, float targetLF = 0.5, split_gpuStream_t s = 0) {
@@ -1472,11 +1888,11 @@ public:
    class device_iterator {
    private:
       size_t index;
-      Hashmap<KEY_TYPE, VAL_TYPE>* hashtable;
+      Hashmap* hashtable;
 
    public:
       HASHINATOR_DEVICEONLY
-      device_iterator(Hashmap<KEY_TYPE, VAL_TYPE>& hashtable, size_t index) : index(index), hashtable(&hashtable) {}
+      device_iterator(Hashmap& hashtable, size_t index) : index(index), hashtable(&hashtable) {}
 
       HASHINATOR_DEVICEONLY
       size_t getIndex() { return index; }
@@ -1518,11 +1934,11 @@ public:
    class const_device_iterator {
    private:
       size_t index;
-      const Hashmap<KEY_TYPE, VAL_TYPE>* hashtable;
+      const Hashmap* hashtable;
 
    public:
       HASHINATOR_DEVICEONLY
-      explicit const_device_iterator(const Hashmap<KEY_TYPE, VAL_TYPE>& hashtable, size_t index)
+      explicit const_device_iterator(const Hashmap& hashtable, size_t index)
           : index(index), hashtable(&hashtable) {}
 
       HASHINATOR_DEVICEONLY
@@ -1729,6 +2145,33 @@ private:
       return false;
    }
 
+   /**Device code for reducing into elements, see set_element_reduce.
+    */
+   template <typename Op>
+   HASHINATOR_DEVICEONLY
+   bool reduce_element(const KEY_TYPE& key, VAL_TYPE value, Op op, size_t& thread_overflowLookup) {
+      int bitMask = (1 << _mapInfo->sizePower) - 1; // For efficient modulo of the array size
+      auto hashIndex = hash(key);
+      size_t i = 0;
+      const size_t bsize = buckets.size();
+      while (i < bsize) {
+         uint32_t vecindex = (hashIndex + i) & bitMask;
+         KEY_TYPE old = split::s_atomicCAS(&(buckets[vecindex].first), EMPTYBUCKET, key);
+         if (old == EMPTYBUCKET || old == key) {
+            Reducers::device_apply(&(buckets[vecindex].second), value, op);
+            thread_overflowLookup = i + 1;
+            if (old == EMPTYBUCKET) {
+               split::s_atomicAdd(&(_mapInfo->fill), 1);
+               return true;
+            }
+            return false;
+         }
+         i++;
+      }
+      assert(false && "Hashmap completely overflown");
+      return false;
+   }
+
 public:
    template <bool skipOverWrites = false>
    HASHINATOR_DEVICEONLY
@@ -1748,6 +2191,30 @@ public:
       return newentry;
    }
 
+   // Sets the value of all empty buckets to op.identity(). Call on host before launching kernels
+   // that use set_element_reduce.
+   template <typename Op>
+   void prepare_reduce(Op op, split_gpuStream_t s = 0) {
+      (void)op;
+      // fast ceil for positive ints
+      const size_t blocks = buckets.size() / defaults::MAX_BLOCKSIZE + (buckets.size() % defaults::MAX_BLOCKSIZE != 0);
+      Hashers::reset_empty_values<KEY_TYPE, VAL_TYPE, EMPTYBUCKET>
+          <<<blocks, defaults::MAX_BLOCKSIZE, 0, s>>>(buckets.data(), Op::identity(), buckets.size());
+      SPLIT_CHECK_ERR(split_gpuStreamSynchronize(s));
+   }
+
+   // Device code for reducing val into the value of key with op. Nonexistent elements get created
+   // starting from op.identity(), which requires prepare_reduce to have been called.
+   template <typename Op>
+   HASHINATOR_DEVICEONLY
+   bool set_element_reduce(const KEY_TYPE& key, VAL_TYPE val, Op op) {
+      size_t thread_overflowLookup = 0;
+      const bool newentry = reduce_element(key, val, op, thread_overflowLookup);
+      split::s_atomicMax(&(_mapInfo->currentMaxBucketOverflow),
+                         nextOverflow(thread_overflowLookup, defaults::WARPSIZE / defaults::elementsPerWarp));
+      return newentry;
+   }
+
    HASHINATOR_DEVICEONLY
    const VAL_TYPE& read_element(const KEY_TYPE& key) const {
       int bitMask = (1 << _mapInfo->sizePower) - 1; // For efficient modulo of the array size
@@ -1772,34 +2239,770 @@ public:
 
 #else
 
+   /*
+    * The batch operations below take a host stream like their device counterparts take a GPU one,
+    * see split_host_stream.h. With a stream the whole operation, growing the table included, is
+    * queued and the call returns at once; the map and the arrays passed in must then be left
+    * alone until the stream is synchronized. Without one the call blocks as before.
+    */
+
+
+   /*
+    * Radix-partitioned batch insert for batches far larger than the last level cache.
+    * The table is first grown to reach targetLF. The input is then partitioned by the high bits
+    * of hash(key), which select a contiguous region of buckets, and the partitions are inserted
+    * in parallel so that each thread only touches a cache and TLB resident part of the buckets.
+    * Even and odd partitions are inserted in two phases, so the overflow of a partition into the
+    * next region never races with another thread. Elements that would overflow even further are
+    * inserted serially at the end. Tables too small to be partitioned fall back to insert().
+    */
+   void insert_partitioned(KEY_TYPE* keys, VAL_TYPE* vals, size_t len, float targetLF = 0.5) {
+      _insert_partitioned(len, targetLF,
+                          [keys, vals](size_t i) { return hash_pair<KEY_TYPE, VAL_TYPE>(keys[i], vals[i]); });
+   }
+
+   void insert_partitioned(hash_pair<KEY_TYPE, VAL_TYPE>* src, size_t len, float targetLF = 0.5) {
+      _insert_partitioned(len, targetLF, [src](size_t i) { return src[i]; });
+   }
+
+   /*
+    * Batch operations of the device path. They run DeviceHasher, by default the host Hasher of
+    * hashers.h, so the warp cooperative kernels and their semantics are the same as on a GPU:
+    * the table is grown upfront to reach targetLF, and grown again only if some elements still
+    * did not fit, after which the batch is inserted again. A key repeated within one insert batch
+    * ends up with any one of its values, as on the device. Without a hasher (DeviceHasher = void)
+    * the elements are handled one by one and the last value of a repeated key wins, as it does in
+    * insert_partitioned.
+    */
+
    // Uses Hasher's insert_kernel to insert all elements
-   void insert(KEY_TYPE* keys, VAL_TYPE* vals, size_t len, float targetLF = 0.5) {
-      for (size_t i = 0; i < len; ++i) {
-         _at(keys[i]) = vals[i];
-      }
+   void insert(KEY_TYPE* keys, VAL_TYPE* vals, size_t len, float targetLF = 0.5, split_gpuStream_t s = 0) {
+      split::host_launch(s, [this, keys, vals, len, targetLF]() {
+         if (len == 0) {
+            set_status(status::success);
+            return;
+         }
+         _presize(len, targetLF);
+         if constexpr (std::is_void<DeviceHasher>::value) {
+            for (size_t i = 0; i < len; ++i) {
+               _at(keys[i]) = vals[i];
+            }
+         } else {
+            _hasher_insert(
+                len, [keys](size_t i) { return keys[i]; },
+                [&]() { DeviceHasher::insert(keys, vals, buckets.data(), _mapInfo, len); });
+         }
+      });
    }
 
    // Uses Hasher's insert_kernel to insert all elements
-   void insert(hash_pair<KEY_TYPE, VAL_TYPE>* src, size_t len, float targetLF = 0.5) {
-      for (size_t i = 0; i < len; ++i) {
-         _at(src[i].first) = src[i].second;
+   void insert(hash_pair<KEY_TYPE, VAL_TYPE>* src, size_t len, float targetLF = 0.5, split_gpuStream_t s = 0) {
+      split::host_launch(s, [this, src, len, targetLF]() {
+         if (len == 0) {
+            set_status(status::success);
+            return;
+         }
+         _presize(len, targetLF);
+         if constexpr (std::is_void<DeviceHasher>::value) {
+            for (size_t i = 0; i < len; ++i) {
+               _at(src[i].first) = src[i].second;
+            }
+         } else {
+            _hasher_insert(
+                len, [src](size_t i) { return src[i].first; },
+                [&]() { DeviceHasher::insert(src, buckets.data(), _mapInfo, len); });
+         }
+      });
+   }
+
+   // Uses Hasher's insert_index_kernel to insert all elements, with the index as the value
+   void insertIndex(KEY_TYPE* keys, size_t len, float targetLF = 0.5, split_gpuStream_t s = 0) {
+      split::host_launch(s, [this, keys, len, targetLF]() {
+         if (len == 0) {
+            set_status(status::success);
+            return;
+         }
+         _presize(len, targetLF);
+         if constexpr (std::is_void<DeviceHasher>::value) {
+            for (size_t i = 0; i < len; ++i) {
+               _at(keys[i]) = static_cast<VAL_TYPE>(i);
+            }
+         } else {
+            _hasher_insert(
+                len, [keys](size_t i) { return keys[i]; },
+                [&]() { DeviceHasher::insertIndex(keys, buckets.data(), _mapInfo, len); });
+         }
+      });
+   }
+
+   // Uses Hasher's delete_kernel to delete all elements
+   void erase(KEY_TYPE* keys, size_t len, split_gpuStream_t s = 0) {
+      split::host_launch(s, [this, keys, len]() {
+         if constexpr (std::is_void<DeviceHasher>::value) {
+            for (size_t i = 0; i < len; ++i) {
+               erase(keys[i]);
+            }
+         } else {
+            // Small batches clear the occupancy bits of the buckets they erase from, found up front
+            const bool perKey = !_occupancy.empty() && _update_per_key(len);
+            std::vector<size_t> slots(perKey ? len : 0);
+            for (size_t i = 0; i < slots.size(); ++i) {
+               slots[i] = _probe_index(keys[i], hash(keys[i]));
+            }
+            // Remember the last numeber of tombstones
+            size_t tbStore = tombstone_count();
+            DeviceHasher::erase(keys, buckets.data(), _mapInfo, len);
+            // Fill should be decremented by the number of tombstones added;
+            _mapInfo->fill -= tombstone_count() - tbStore;
+            if (!perKey) {
+               _occupancy_rebuild();
+            }
+            for (size_t i = 0; i < slots.size(); ++i) {
+               if (slots[i] < buckets.size() && buckets[slots[i]].first != keys[i]) {
+                  _occupancy_clear(slots[i]);
+               }
+            }
+         }
+      });
+   }
+
+   /*
+    * Copies the elements matching rule(element) == true to elements, in bucket order, and returns
+    * their number. With a stream the extraction is queued like the other batch operations and 0
+    * is returned, elements.size() holds the number once the stream is synchronized.
+    */
+   template <typename Rule>
+   size_t extractPattern(split::SplitVector<hash_pair<KEY_TYPE, VAL_TYPE>>& elements, Rule rule,
+                         split_gpuStream_t s = 0) {
+      if (s != nullptr) {
+         s->enqueue([this, &elements, rule]() { _extract_pattern(elements, rule); });
+         return 0;
       }
+      return _extract_pattern(elements, rule);
    }
 
-   // Uses Hasher's retrieve_kernel to read all elements
-   void retrieve(KEY_TYPE* keys, VAL_TYPE* vals, size_t len) {
-      for (size_t i = 0; i < len; ++i) {
-         vals[i] = at(keys[i]);
+   // Rebuilds the table in place, which drops the tombstones and brings the overflow back down
+   void clean_tombstones(split_gpuStream_t s = 0) {
+      split::host_launch(s, [this]() {
+         if (_mapInfo->tombstoneCounter > 0) {
+            rehash(_mapInfo->sizePower);
+         }
+      });
+   }
+
+   // Uses Hasher's retrieve_kernel, which prefetches the home buckets of its windows. Without a
+   // hasher the lookup uses group prefetching: the home buckets of a window of WINDOW keys are
+   // hashed and prefetched first and only then probed, so that their cache misses overlap.
+   // As with the device retrieve, values of keys not present in the map are left untouched.
+   template <int WINDOW = defaults::PREFETCH_WINDOW>
+   void retrieve(KEY_TYPE* keys, VAL_TYPE* vals, size_t len, split_gpuStream_t s = 0) {
+      split::host_launch(s, [this, keys, vals, len]() {
+         performCleanupTasks();
+         if constexpr (std::is_void<DeviceHasher>::value) {
+            _probe_batched<WINDOW>(keys, len, [&](size_t i, size_t index) {
+               if (index != buckets.size()) {
+                  vals[i] = buckets[index].second;
+               }
+            });
+         } else {
+            DeviceHasher::retrieve(keys, vals, buckets.data(), _mapInfo, len);
+         }
+      });
+   }
+
+   // Batched membership test on the same prefetching path as retrieve. Bit (i % 64) of bitmask[i / 64]
+   // is set if keys[i] is in the map; bitmask must hold (len + 63) / 64 words and is overwritten.
+   template <int WINDOW = defaults::PREFETCH_WINDOW>
+   void contains(const KEY_TYPE* keys, size_t len, uint64_t* bitmask) {
+      performCleanupTasks();
+      std::fill(bitmask, bitmask + (len + 63) / 64, uint64_t(0));
+      _probe_batched<WINDOW>(keys, len, [&](size_t i, size_t index) {
+         if (index != buckets.size()) {
+            bitmask[i / 64] |= uint64_t(1) << (i % 64);
+         }
+      });
+   }
+
+   // Batched lookup of bucket indices: slots[i] is the bucket holding keys[i], or bucket_count() if
+   // keys[i] is not in the map. Indices stay valid until the map is modified.
+   template <int WINDOW = defaults::PREFETCH_WINDOW>
+   void find_slots(const KEY_TYPE* keys, size_t len, size_t* slots) {
+      performCleanupTasks();
+      _probe_batched<WINDOW>(keys, len, [&](size_t i, size_t index) { slots[i] = index; });
+   }
+
+   /*
+    * Optional occupancy bitmap with one bit per bucket, set iff the bucket holds an element.
+    * Every host insertion and erasure keeps it exact, and in exchange begin(), iterator increments,
+    * for_each and extractAllKeys jump over 64 empty or tombstoned buckets per word on sparse tables.
+    */
+   void track_occupancy(bool enable = true) {
+      if (enable == tracks_occupancy()) {
+         return;
+      }
+      if (enable) {
+         _occupancy.resize(1);
+         _occupancy_rebuild();
+      } else {
+         std::vector<uint64_t>().swap(_occupancy);
       }
    }
 
-   // Uses Hasher's erase_kernel to delete all elements
-   void erase(KEY_TYPE* keys, VAL_TYPE* vals, size_t len) {
+   bool tracks_occupancy() const noexcept { return !_occupancy.empty(); }
+
+   /*
+    * Optional blocked Bloom filter checked before probing in find, count, contains and find_slots,
+    * so that most misses cost one cache line instead of a probe chain. retrieve only checks it
+    * without a DeviceHasher, the Hasher kernels probe the buckets directly. It is sized for
+    * bucket_count() keys at falsePositiveRate, which takes about 1.6 * log2(1 / falsePositiveRate)
+    * bits per bucket, and is rebuilt on every rehash. Erased keys stay in it until then.
+    */
+   void enable_bloom_filter(float falsePositiveRate = 0.01) {
+      _bloom.reset(buckets.size(), falsePositiveRate);
+      _bloom_rebuild();
+   }
+
+   void disable_bloom_filter() { _bloom.release(); }
+
+   bool has_bloom_filter() const noexcept { return _bloom.enabled(); }
+
+   // Number of live buckets counted from the bitmap, or from the buckets if it is off. Equals size().
+   size_t count_occupied() const {
+      std::vector<size_t> counts(split::tools::host_threads(), 0);
+      split::tools::parallel_for(
+          (buckets.size() + 63) / 64,
+          [&](size_t firstWord, size_t lastWord, size_t chunk) {
+             for (size_t word = firstWord; word < lastWord; ++word) {
+                counts[chunk] += __builtin_popcountll(_occupancy.empty() ? _scan_live(word) : _occupancy[word]);
+             }
+          },
+          (1ul << 14) / 64);
+      size_t total = 0;
+      for (size_t c : counts) {
+         total += c;
+      }
+      return total;
+   }
+
+   // Copies all keys to elements, in bucket order, and returns their number
+   size_t extractAllKeys(split::SplitVector<KEY_TYPE>& elements) const {
+      elements.resize(_mapInfo->fill);
+      size_t n = 0;
+      for (size_t i = _next_live(0); i < buckets.size(); i = _next_live(i + 1)) {
+         elements[n++] = buckets[i].first;
+      }
+      assert(n == _mapInfo->fill && "Hashmap fill does not match its contents");
+      return n;
+   }
+
+   /*
+    * Whole map passes on host threads. The buckets are split in blocks of 64 and every chunk of
+    * blocks goes to one thread, which takes the live buckets of a block from the occupancy bitmap
+    * or from one branch free scan and then only visits those. fn is called concurrently and must
+    * not modify the map.
+    */
+
+   // Calls fn(key, value) for every element, value may be modified in place
+   template <typename Fn>
+   void for_each(Fn fn) {
+      _for_each_live([&](size_t i, size_t) { fn(static_cast<const KEY_TYPE&>(buckets[i].first), buckets[i].second); });
+   }
+
+   // Replaces every value with fn(key, value)
+   template <typename Fn>
+   void transform_values(Fn fn) {
+      _for_each_live([&](size_t i, size_t) {
+         buckets[i].second = fn(static_cast<const KEY_TYPE&>(buckets[i].first), buckets[i].second);
+      });
+   }
+
+   // Returns init combined with the values of all elements using op, which must be associative and commutative
+   template <typename T, typename Op>
+   T reduce(T init, Op op) const {
+      return reduce(init, op, [](const KEY_TYPE&, const VAL_TYPE& value) -> T { return value; });
+   }
+
+   // Same as above but every element contributes fn(key, value)
+   template <typename T, typename Op, typename Fn>
+   T reduce(T init, Op op, Fn fn) const {
+      std::vector<std::optional<T>> partial(split::tools::host_threads());
+      _for_each_live([&](size_t i, size_t chunk) {
+         const T contribution = fn(buckets[i].first, buckets[i].second);
+         partial[chunk] = partial[chunk] ? op(*partial[chunk], contribution) : contribution;
+      });
+      for (const auto& p : partial) {
+         if (p) {
+            init = op(init, *p);
+         }
+      }
+      return init;
+   }
+
+#ifdef __cpp_lib_atomic_ref
+   /*
+    * Batch upsert with reduction on host threads: keys already in the map get op(old, val) and new
+    * keys start from op.identity(). op is any reducer as described in reducers.h.
+    * As insert() the map is grown once upfront so that fill + len elements fit at targetLF. Keys
+    * that still do not fit in the overflow window make the map grow once more, sized for the keys
+    * left, after which only those keys are retried.
+    */
+   template <typename Op>
+   void insert_reduce(KEY_TYPE* keys, VAL_TYPE* vals, size_t len, Op op, float targetLF = 0.5) {
+      if (len == 0) {
+         return;
+      }
+      performCleanupTasks();
+      _presize(len, targetLF);
+      _insert_reduce(len, op, targetLF,
+                     [keys, vals](size_t i) { return hash_pair<KEY_TYPE, VAL_TYPE>(keys[i], vals[i]); });
+   }
+
+   /*
+    * Merges other into this map on host threads: keys of both maps get op(this[key], other[key]),
+    * keys only in other are copied over. The buckets of other are split in chunks and reduced in
+    * parallel, so folding thread local partial maps into a global one is not a serial section.
+    * The map is grown upfront so that both maps fit at targetLF even if their keys are disjoint.
+    */
+   template <typename Op>
+   void merge(const Hashmap& other, Op op, float targetLF = 0.5) {
+      assert(&other != this && "Cannot merge a map with itself");
+      if (other.size() == 0) {
+         return;
+      }
+      performCleanupTasks();
+      _presize(other.size(), targetLF);
+      const hash_pair<KEY_TYPE, VAL_TYPE>* src = other.buckets.data();
+      _insert_reduce(other.buckets.size(), op, targetLF, [src](size_t i) { return src[i]; });
+   }
+#endif
+
+   // Erases in parallel every key that is not in other. Values are left untouched.
+   void intersect(const Hashmap& other) {
+      assert(&other != this && "Cannot intersect a map with itself");
+      _erase_if_found(other, false);
+   }
+
+   // Erases in parallel every key that is also in other
+   void subtract(const Hashmap& other) {
+      assert(&other != this && "Cannot subtract a map from itself");
+      _erase_if_found(other, true);
+   }
+
+private:
+   // Batches this small against the table keep the occupancy bitmap and the bloom filter up to
+   // date key by key, larger ones rebuild them from the buckets
+   bool _update_per_key(size_t len) const noexcept { return len * 16 <= buckets.size(); }
+
+   // Runs launch, one of the DeviceHasher inserts, for a whole batch whose i-th key is keyOf(i).
+   // If some elements did not fit the table grows and the batch is inserted again, which only
+   // overwrites the elements in place.
+   template <typename KeyOf, typename Launch>
+   void _hasher_insert(size_t len, KeyOf keyOf, Launch&& launch) {
+      launch();
+      while (_mapInfo->err == status::fail) {
+         rehash(_mapInfo->sizePower + 1);
+         launch();
+      }
+      if (_occupancy.empty() && !_bloom.enabled()) {
+         return;
+      }
+      if (!_update_per_key(len)) {
+         _occupancy_rebuild();
+         _bloom_rebuild();
+         return;
+      }
       for (size_t i = 0; i < len; ++i) {
-         erase(keys[i].first);
+         const KEY_TYPE key = keyOf(i);
+         if (key == EMPTYBUCKET || key == TOMBSTONE) {
+            continue;
+         }
+         const size_t index = _probe_index(key, hash(key));
+         if (index < buckets.size()) {
+            _occupancy_set(index);
+            _bloom_add(key);
+         }
       }
    }
 
+   // Single upfront rehash of the batch inserts, so that a large batch does not double the table
+   // over and over while it is being inserted. The Hasher kernels do not reuse tombstones, so if
+   // they would push fill + tombstones + len past targetLF the table is rebuilt in place first.
+   void _presize(size_t len, float targetLF) {
+      if (len == 0) {
+         return;
+      }
+      int64_t neededPowerSize = std::ceil(std::log2((_mapInfo->fill + len) * (1.0 / targetLF)));
+      if (neededPowerSize > _mapInfo->sizePower) {
+         rehash(neededPowerSize);
+      } else if (_mapInfo->tombstoneCounter > 0 &&
+                 _mapInfo->fill + _mapInfo->tombstoneCounter + len > targetLF * buckets.size()) {
+         rehash(_mapInfo->sizePower);
+      }
+   }
+
+   // Parallel copy_if over the buckets: every chunk counts its matches, the counts are scanned into
+   // offsets and a second pass over the same chunks writes the matches in bucket order
+   template <typename Rule>
+   size_t _extract_pattern(split::SplitVector<hash_pair<KEY_TYPE, VAL_TYPE>>& elements, Rule rule) {
+      const size_t nBlocks = (buckets.size() + 63) / 64;
+      const size_t nChunks = std::max<size_t>(1, std::min(split::tools::host_threads(), nBlocks / 256));
+      std::vector<size_t> offsets(nChunks + 1, 0);
+      auto forChunk = [&](size_t chunk, auto&& fn) {
+         const size_t last = std::min(buckets.size(), (nBlocks * (chunk + 1)) / nChunks * 64);
+         for (size_t i = _next_live((nBlocks * chunk) / nChunks * 64); i < last; i = _next_live(i + 1)) {
+            if (rule(buckets[i])) {
+               fn(buckets[i]);
+            }
+         }
+      };
+      // parallel_for hands out ranges of chunk indices, however many threads it ends up using
+      split::tools::parallel_for(nChunks, [&](size_t begin, size_t end, size_t) {
+         for (size_t chunk = begin; chunk < end; ++chunk) {
+            forChunk(chunk, [&](const hash_pair<KEY_TYPE, VAL_TYPE>&) { ++offsets[chunk + 1]; });
+         }
+      });
+      for (size_t chunk = 0; chunk < nChunks; ++chunk) {
+         offsets[chunk + 1] += offsets[chunk];
+      }
+      elements.resize(offsets[nChunks]);
+      hash_pair<KEY_TYPE, VAL_TYPE>* out = elements.data();
+      split::tools::parallel_for(nChunks, [&](size_t begin, size_t end, size_t) {
+         for (size_t chunk = begin; chunk < end; ++chunk) {
+            size_t n = offsets[chunk];
+            forChunk(chunk, [&](const hash_pair<KEY_TYPE, VAL_TYPE>& element) { out[n++] = element; });
+         }
+      });
+      return elements.size();
+   }
+
+   // Calls fn(index, chunk) for every live bucket, see for_each
+   template <typename Fn>
+   void _for_each_live(Fn&& fn) const {
+      const size_t nBlocks = (buckets.size() + 63) / 64;
+      split::tools::parallel_for(
+          nBlocks,
+          [&](size_t firstBlock, size_t lastBlock, size_t chunk) {
+             for (size_t block = firstBlock; block < lastBlock; ++block) {
+                uint64_t live = _occupancy.empty() ? _scan_live(block) : _occupancy[block];
+                while (live != 0) {
+                   fn(block * 64 + __builtin_ctzll(live), chunk);
+                   live &= live - 1;
+                }
+             }
+          },
+          (1ul << 14) / 64);
+   }
+
+   // Group prefetched probing shared by the batched lookups: calls fn(i, index) for every key with
+   // index the bucket holding keys[i] or buckets.size() if it is not in the map.
+   template <int WINDOW, typename Fn>
+   void _probe_batched(const KEY_TYPE* keys, size_t len, Fn&& fn) const {
+      static_assert(WINDOW > 0, "Prefetch window must be positive");
+      const size_t bitMask = buckets.size() - 1;
+      size_t home[WINDOW];
+      for (size_t base = 0; base < len; base += WINDOW) {
+         const size_t n = std::min(len - base, static_cast<size_t>(WINDOW));
+         // Stage 1: compute home buckets and issue the prefetches
+         for (size_t j = 0; j < n; ++j) {
+            home[j] = hash(keys[base + j]) & bitMask;
+            prefetch(&buckets[home[j]]);
+         }
+         // Stage 2: resolve the lookups, their home buckets should be in flight by now
+         for (size_t j = 0; j < n; ++j) {
+            fn(base + j, _find_index(keys[base + j], home[j]));
+         }
+      }
+   }
+
+#ifdef __cpp_lib_atomic_ref
+   // Same claiming as concurrent_insert but the value of the claimed or found bucket is combined
+   // with op, and the probe gives up at the end of the overflow window whatever the bucket there
+   // holds, as the device kernels do. Empty buckets must hold op.identity() beforehand, see
+   // _reset_empty_values.
+   template <typename Op>
+   status _concurrent_reduce(const KEY_TYPE& key, const VAL_TYPE& value, Op op) noexcept {
+      const size_t bitMask = (1ul << _mapInfo->sizePower) - 1; // For efficient modulo of the array size
+      const size_t maxOverflow = std::min(_mapInfo->currentMaxBucketOverflow, buckets.size());
+      const auto hashIndex = hash(key);
+
+      for (size_t i = 0; i < maxOverflow; i++) {
+         hash_pair<KEY_TYPE, VAL_TYPE>& candidate = buckets[(hashIndex + i) & bitMask];
+         std::atomic_ref<KEY_TYPE> slot(candidate.first);
+         KEY_TYPE old = slot.load(std::memory_order_acquire);
+         if (old == EMPTYBUCKET) {
+            if (slot.compare_exchange_strong(old, key, std::memory_order_acq_rel)) {
+               std::atomic_ref<size_t>(_mapInfo->fill).fetch_add(1, std::memory_order_relaxed);
+               _occupancy_set_atomic((hashIndex + i) & bitMask);
+               if (_bloom.enabled()) {
+                  _bloom.insert_concurrent(key);
+               }
+               old = key;
+            }
+         }
+         if (old == key) {
+            Reducers::host_apply(&candidate.second, value, op);
+            return status::success;
+         }
+      }
+      return status::fail;
+   }
+
+   // Reduces source(i) for i in [0, n) into the map, skipping empty and tombstoned entries.
+   // Entries that do not fit in the overflow window make the map grow, by at least one power and
+   // enough for them to fit at targetLF, after which only those are retried. The rehash also packs
+   // every key back into the overflow window, so keys placed further away by _at are found again.
+   template <typename Op, typename Source>
+   void _insert_reduce(size_t n, Op op, float targetLF, Source source) {
+      const size_t nThreads = split::tools::host_threads();
+      std::vector<std::vector<hash_pair<KEY_TYPE, VAL_TYPE>>> failed(nThreads);
+      _reset_empty_values(Op::identity());
+      split::tools::parallel_for(
+          n,
+          [&](size_t begin, size_t end, size_t chunk) {
+             for (size_t i = begin; i < end; ++i) {
+                const hash_pair<KEY_TYPE, VAL_TYPE> e = source(i);
+                if (e.first == EMPTYBUCKET || e.first == TOMBSTONE) {
+                   continue;
+                }
+                if (_concurrent_reduce(e.first, e.second, op) != status::success) {
+                   failed[chunk].push_back(e);
+                }
+             }
+          },
+          1ul << 12, nThreads);
+
+      std::vector<hash_pair<KEY_TYPE, VAL_TYPE>> retry;
+      while (true) {
+         retry.clear();
+         for (auto& list : failed) {
+            retry.insert(retry.end(), list.begin(), list.end());
+            list.clear();
+         }
+         if (retry.empty()) {
+            break;
+         }
+         const int neededPowerSize = std::ceil(std::log2((_mapInfo->fill + retry.size()) * (1.0 / targetLF)));
+         rehash(std::max(neededPowerSize, _mapInfo->sizePower + 1));
+         _reset_empty_values(Op::identity());
+         split::tools::parallel_for(
+             retry.size(),
+             [&](size_t begin, size_t end, size_t chunk) {
+                for (size_t i = begin; i < end; ++i) {
+                   if (_concurrent_reduce(retry[i].first, retry[i].second, op) != status::success) {
+                      failed[chunk].push_back(retry[i]);
+                   }
+                }
+             },
+             1ul << 12, nThreads);
+      }
+   }
+
+   // Sets the value of every empty bucket to identity
+   void _reset_empty_values(const VAL_TYPE& identity) {
+      split::tools::parallel_for(
+          buckets.size(),
+          [&](size_t begin, size_t end, size_t) {
+             for (size_t i = begin; i < end; ++i) {
+                if (buckets[i].first == EMPTYBUCKET) {
+                   buckets[i].second = identity;
+                }
+             }
+          },
+          1ul << 16);
+   }
+#endif
+
+   // Tombstones in parallel every key whose presence in other equals erasePresent
+   void _erase_if_found(const Hashmap& other, bool erasePresent) {
+      if (size() == 0) {
+         return;
+      }
+      const size_t otherMask = other.buckets.size() - 1;
+      std::vector<size_t> erased(split::tools::host_threads(), 0);
+      split::tools::parallel_for(
+          buckets.size(),
+          [&](size_t begin, size_t end, size_t chunk) {
+             for (size_t i = begin; i < end; ++i) {
+                const KEY_TYPE key = buckets[i].first;
+                if (key == EMPTYBUCKET || key == TOMBSTONE) {
+                   continue;
+                }
+                const bool present = other.size() != 0 &&
+                                     other._find_index(key, other.hash(key) & otherMask) != other.buckets.size();
+                if (present == erasePresent) {
+                   buckets[i].first = TOMBSTONE;
+                   erased[chunk]++;
+                }
+             }
+          },
+          1ul << 14, erased.size());
+      for (size_t count : erased) {
+         _mapInfo->fill -= count;
+         _mapInfo->tombstoneCounter += count;
+      }
+      _occupancy_rebuild();
+      performCleanupTasks();
+   }
+
+   // Inserts element e probing at most maxDist buckets away from home.
+   // Returns false, leaving the buckets untouched, if it did not fit.
+   bool _insert_bounded(const hash_pair<KEY_TYPE, VAL_TYPE>& e, size_t home, size_t maxDist, int64_t& fillDelta,
+                        int64_t& tombstoneDelta) noexcept {
+      const size_t bsize = buckets.size();
+      const size_t bitMask = bsize - 1;
+      size_t firstTombstone = bsize;
+      maxDist = std::min(maxDist, bsize);
+      for (size_t i = 0; i < maxDist; i++) {
+         const size_t index = (home + i) & bitMask;
+         hash_pair<KEY_TYPE, VAL_TYPE>& candidate = buckets[index];
+         if (candidate.first == e.first) {
+            candidate.second = e.second;
+            return true;
+         }
+         if (candidate.first == TOMBSTONE && firstTombstone == bsize) {
+            firstTombstone = index;
+         }
+         if (candidate.first == EMPTYBUCKET) {
+            // The key is not in the map. Reuse the first tombstone we passed if there was one.
+            if (firstTombstone != bsize) {
+               buckets[firstTombstone] = e;
+               tombstoneDelta--;
+               _occupancy_set(firstTombstone);
+            } else {
+               candidate = e;
+               _occupancy_set(index);
+            }
+            fillDelta++;
+            return true;
+         }
+      }
+      return false;
+   }
+
+   template <typename Source>
+   void _insert_partitioned(size_t len, float targetLF, Source source) {
+      if (len == 0) {
+         return;
+      }
+      performCleanupTasks();
+      _presize(len, targetLF);
+
+      const int sizePower = _mapInfo->sizePower;
+      const int radixBits = std::min(sizePower - defaults::PARTITION_REGION_POWER, defaults::MAX_PARTITION_BITS);
+      if (radixBits < 1) {
+         // Table is small enough to stay cache resident anyway
+         for (size_t i = 0; i < len; ++i) {
+            const hash_pair<KEY_TYPE, VAL_TYPE> e = source(i);
+            _at(e.first) = e.second;
+         }
+         return;
+      }
+      const size_t nPartitions = 1ul << radixBits;
+      const int shift = sizePower - radixBits;
+      const size_t bitMask = (1ul << sizePower) - 1;
+      const size_t nThreads = split::tools::host_threads();
+      const size_t minChunk = 1ul << 14;
+
+      // Pass 1: per chunk histograms of the partition ids
+      std::vector<size_t> offsets(nThreads * nPartitions, 0);
+      const size_t nChunks = split::tools::parallel_for(
+          len,
+          [&](size_t begin, size_t end, size_t chunk) {
+             size_t* histogram = &offsets[chunk * nPartitions];
+             for (size_t i = begin; i < end; ++i) {
+                histogram[(hash(source(i).first) & bitMask) >> shift]++;
+             }
+          },
+          minChunk, nThreads);
+
+      // Exclusive scan in partition-major order so that every partition ends up contiguous
+      std::vector<size_t> partitionStart(nPartitions + 1, 0);
+      size_t running = 0;
+      for (size_t p = 0; p < nPartitions; ++p) {
+         partitionStart[p] = running;
+         for (size_t chunk = 0; chunk < nChunks; ++chunk) {
+            const size_t count = offsets[chunk * nPartitions + p];
+            offsets[chunk * nPartitions + p] = running;
+            running += count;
+         }
+      }
+      partitionStart[nPartitions] = running;
+
+      // Pass 2: scatter. Chunks are identical to pass 1 so every chunk writes its own slots
+      std::vector<hash_pair<KEY_TYPE, VAL_TYPE>> staging(len);
+      split::tools::parallel_for(
+          len,
+          [&](size_t begin, size_t end, size_t chunk) {
+             size_t* cursor = &offsets[chunk * nPartitions];
+             for (size_t i = begin; i < end; ++i) {
+                const hash_pair<KEY_TYPE, VAL_TYPE> e = source(i);
+                staging[cursor[(hash(e.first) & bitMask) >> shift]++] = e;
+             }
+          },
+          minChunk, nThreads);
+
+      // Pass 3: insert even then odd partitions. A partition may overflow into the next region
+      // but not further, as that one could be in use by another thread.
+      // With the blocked NUMA policy the partitions of node k live in the k-th slice of the buckets,
+      // so workers are pinned to a node and drain its partitions before helping the other nodes.
+      const size_t regionSize = 1ul << shift;
+      const size_t nNodes = split::tools::host_numa_policy() == split::tools::numa_policy::blocked
+                                ? std::min(split::tools::numa_nodes(), nPartitions)
+                                : 1;
+      std::vector<std::vector<hash_pair<KEY_TYPE, VAL_TYPE>>> deferred(nThreads);
+      std::vector<int64_t> fillDelta(nThreads, 0);
+      std::vector<int64_t> tombstoneDelta(nThreads, 0);
+      std::vector<std::atomic<size_t>> nextPartition(nNodes);
+      for (size_t phase = 0; phase < 2; ++phase) {
+         for (auto& counter : nextPartition) {
+            counter.store(0);
+         }
+         // Next partition of this phase in the range of node, nPartitions once drained
+         auto claim = [&](size_t node) -> size_t {
+            const size_t first = (node * nPartitions) / nNodes;
+            const size_t last = ((node + 1) * nPartitions) / nNodes;
+            const size_t p = first + ((first + phase) & 1) + 2 * nextPartition[node].fetch_add(1);
+            return p < last ? p : nPartitions;
+         };
+         split::tools::parallel_for(
+             nThreads,
+             [&](size_t, size_t, size_t worker) {
+                // The calling thread keeps its affinity
+                if (nNodes > 1 && worker != 0) {
+                   split::tools::pin_thread_to_node(worker % nNodes);
+                }
+                for (size_t n = 0; n < nNodes; ++n) {
+                   const size_t node = (worker + n) % nNodes;
+                   for (size_t p = claim(node); p < nPartitions; p = claim(node)) {
+                      const size_t regionEnd = (p + 2) * regionSize;
+                      for (size_t i = partitionStart[p]; i < partitionStart[p + 1]; ++i) {
+                         const hash_pair<KEY_TYPE, VAL_TYPE>& e = staging[i];
+                         const size_t home = hash(e.first) & bitMask;
+                         if (!_insert_bounded(e, home, regionEnd - home, fillDelta[worker],
+                                              tombstoneDelta[worker])) {
+                            deferred[worker].push_back(e);
+                         }
+                      }
+                   }
+                }
+             },
+             1, nThreads);
+      }
+
+      for (size_t worker = 0; worker < nThreads; ++worker) {
+         _mapInfo->fill += fillDelta[worker];
+         _mapInfo->tombstoneCounter += tombstoneDelta[worker];
+      }
+      // Partitions share filter blocks, so the filter is refilled once all of them are in
+      _bloom_rebuild();
+      for (auto& list : deferred) {
+         for (const auto& e : list) {
+            _at(e.first) = e.second;
+         }
+      }
+   }
+
+public:
 #endif
 };
 } // namespace Hashinator
@@ -0,0 +1,167 @@
+/* File:    hashmap_pool.h
+ * Authors: Kostis Papadakis, Urs Ganse and Markus Battarbee (2023)
+ * Description: Pool of cleared Hashmaps (or Hashsets) that are reused
+ *              for short lived per task maps instead of being freed.
+ *
+ * This file defines the following classes:
+ *    --Hashinator::HashmapPool;
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ * */
+#pragma once
+#include "hashinator.h"
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace Hashinator {
+
+/**
+ * @brief Keeps idle maps grouped by size class so that they can be handed out again.
+ *
+ * acquire(sizePower) returns a Handle to an empty map with at least 2^sizePower buckets, taken
+ * from the pool when one is idle and constructed otherwise. When the Handle goes out of scope
+ * the map is cleared in place and returned to the class of its current size, so a map that grew
+ * while in use is handed out for the larger class next time. At most maxIdle maps are kept per
+ * class; the rest, and maps grown past the largest class, are freed. All members are thread
+ * safe and the lock is only held to move a pointer, never while constructing or clearing a map.
+ *
+ * Example Usage:
+ *
+ *    HashmapPool<Hashmap<uint32_t,uint32_t>> pool;
+ *    for (auto& item : work) {
+ *       auto hmap = pool.acquire(10);
+ *       (*hmap)[item.key] = item.value;
+ *    } // hmap is cleared and back in the pool here
+ */
+template <typename MAP>
+class HashmapPool {
+   static constexpr int SIZE_CLASSES = 32;
+
+public:
+   class Handle {
+   public:
+      Handle() = default;
+      Handle(HashmapPool* pool, std::unique_ptr<MAP> map) : pool(pool), map(std::move(map)) {}
+      Handle(Handle&& other) noexcept = default;
+      Handle& operator=(Handle&& other) noexcept {
+         if (this != &other) {
+            reset();
+            pool = other.pool;
+            map = std::move(other.map);
+         }
+         return *this;
+      }
+      Handle(const Handle&) = delete;
+      Handle& operator=(const Handle&) = delete;
+      ~Handle() { reset(); }
+
+      MAP& operator*() const noexcept { return *map; }
+      MAP* operator->() const noexcept { return map.get(); }
+      MAP* get() const noexcept { return map.get(); }
+      explicit operator bool() const noexcept { return map != nullptr; }
+
+      // Gives the map back to the pool early
+      void reset() {
+         if (map) {
+            pool->release(std::move(map));
+         }
+      }
+
+   private:
+      HashmapPool* pool = nullptr;
+      std::unique_ptr<MAP> map;
+   };
+
+   explicit HashmapPool(size_t maxIdle = 64) : maxIdle(maxIdle) {}
+   HashmapPool(const HashmapPool&) = delete;
+   HashmapPool& operator=(const HashmapPool&) = delete;
+
+   Handle acquire(int sizePower) {
+      checkClass(sizePower);
+      std::unique_ptr<MAP> map;
+      {
+         std::lock_guard<std::mutex> lock(mutex);
+         auto& idle = classes[sizePower];
+         if (!idle.empty()) {
+            map = std::move(idle.back());
+            idle.pop_back();
+         }
+      }
+      if (!map) {
+         map.reset(new MAP(sizePower));
+      }
+      return Handle(this, std::move(map));
+   }
+
+   // Constructs count idle maps of the given class ahead of time
+   void reserve(int sizePower, size_t count) {
+      checkClass(sizePower);
+      for (size_t i = 0; i < count; ++i) {
+         release(std::unique_ptr<MAP>(new MAP(sizePower)));
+      }
+   }
+
+   // Number of idle maps of a size class, 0 for sizes the pool has no class for
+   size_t idle(int sizePower) const {
+      if (!hasClass(sizePower)) {
+         return 0;
+      }
+      std::lock_guard<std::mutex> lock(mutex);
+      return classes[sizePower].size();
+   }
+
+   // Frees every idle map
+   void trim() {
+      std::vector<std::unique_ptr<MAP>> freed[SIZE_CLASSES];
+      {
+         std::lock_guard<std::mutex> lock(mutex);
+         for (int i = 0; i < SIZE_CLASSES; ++i) {
+            freed[i].swap(classes[i]);
+         }
+      }
+   }
+
+private:
+   static bool hasClass(int sizePower) noexcept { return sizePower >= 0 && sizePower < SIZE_CLASSES; }
+
+   static void checkClass(int sizePower) {
+      if (!hasClass(sizePower)) {
+         throw std::invalid_argument("HashmapPool size class out of range");
+      }
+   }
+
+   void release(std::unique_ptr<MAP> map) {
+      const int sizePower = map->getSizePower();
+      if (!hasClass(sizePower)) {
+         // Grew past the largest class, freed right here
+         return;
+      }
+      map->clear();
+      std::lock_guard<std::mutex> lock(mutex);
+      auto& idle = classes[sizePower];
+      if (idle.size() < maxIdle) {
+         idle.push_back(std::move(map));
+      }
+      // Otherwise the map is freed when map goes out of scope, after the unlock
+   }
+
+   size_t maxIdle;
+   mutable std::mutex mutex;
+   std::vector<std::unique_ptr<MAP>> classes[SIZE_CLASSES];
+};
+
+} // namespace Hashinator
@@ -0,0 +1,353 @@
+/* File:    hashset.h
+ * Authors: Kostis Papadakis, Urs Ganse and Markus Battarbee (2023)
+ * Description: A hybrid hash set that stores keys only. It is a thin
+ *              wrapper over Hashinator::Hashmap with key only buckets,
+ *              so probing, rehashing, cleanup and the Hasher kernels
+ *              are the ones of the map.
+ *
+ * This file defines the following classes:
+ *    --Hashinator::Hashset;
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ * */
+#pragma once
+#include "hashinator.h"
+
+namespace Hashinator {
+
+#ifndef HASHINATOR_CPU_ONLY_MODE
+namespace Hashers {
+// One thread per key. SET is the device copy of a Hashset obtained through upload().
+template <typename SET, typename KEY_TYPE>
+__global__ void set_contains_kernel(const SET* set, const KEY_TYPE* keys, bool* found, size_t len) {
+   const size_t tid = threadIdx.x + blockIdx.x * blockDim.x;
+   if (tid < len) {
+      found[tid] = set->device_contains(keys[tid]);
+   }
+}
+} // namespace Hashers
+#endif
+
+/*
+ * Keys only set. The keys live in a Hashmap<KEY_TYPE, KeyOnly>, whose buckets are as large as
+ * a key (see hash_pair.h), and every operation is forwarded to that map.
+ * */
+template <typename KEY_TYPE, KEY_TYPE EMPTYBUCKET = std::numeric_limits<KEY_TYPE>::max(),
+          KEY_TYPE TOMBSTONE = EMPTYBUCKET - 1, class HashFunction = HashFunctions::Fibonacci<KEY_TYPE>,
+          class Meta_Allocator = DefaultMetaAllocator<MapInfo>>
+class Hashset {
+
+   // DefaultHasher is spelled in terms of VAL_TYPE
+   using VAL_TYPE = KeyOnly;
+   using map_type = Hashmap<KEY_TYPE, VAL_TYPE, EMPTYBUCKET, TOMBSTONE, HashFunction, DefaultHasher, Meta_Allocator>;
+   static_assert(sizeof(hash_pair<KEY_TYPE, VAL_TYPE>) == sizeof(KEY_TYPE), "Key only buckets must be bare keys");
+
+private:
+   // CUDA device handle
+   Hashset* device_set;
+   //~CUDA device handle
+
+   map_type _map;
+
+   void preallocate_device_handles() {
+#ifndef HASHINATOR_CPU_ONLY_MODE
+      SPLIT_CHECK_ERR(split_gpuMalloc((void**)&device_set, sizeof(Hashset)));
+#else
+      device_set = nullptr;
+#endif
+   }
+
+   void deallocate_device_handles() {
+      if (device_set == nullptr) {
+         return;
+      }
+#ifndef HASHINATOR_CPU_ONLY_MODE
+      SPLIT_CHECK_ERR(split_gpuFree(device_set));
+      device_set = nullptr;
+#endif
+   }
+
+public:
+   Hashset() : Hashset(5) {}
+
+   Hashset(int sizepower) : _map(sizepower) { preallocate_device_handles(); }
+
+   Hashset(const Hashset& other) : _map(other._map) { preallocate_device_handles(); }
+
+   Hashset(Hashset&& other) : _map(std::move(other._map)) { preallocate_device_handles(); }
+
+   Hashset& operator=(const Hashset& other) {
+      _map = other._map;
+      return *this;
+   }
+
+   Hashset& operator=(Hashset&& other) {
+      _map = std::move(other._map);
+      return *this;
+   }
+
+   ~Hashset() { deallocate_device_handles(); }
+
+#ifdef HASHINATOR_CPU_ONLY_MODE
+   void* operator new(size_t len) {
+      void* ptr = (void*)malloc(len);
+      return ptr;
+   }
+
+   void operator delete(void* ptr) { free(ptr); }
+
+   void* operator new[](size_t len) {
+      void* ptr = (void*)malloc(len);
+      return ptr;
+   }
+
+   void operator delete[](void* ptr) { free(ptr); }
+#else
+   void* operator new(size_t len) {
+      void* ptr;
+      SPLIT_CHECK_ERR(split_gpuMallocManaged(&ptr, len));
+      return ptr;
+   }
+
+   void operator delete(void* ptr) { SPLIT_CHECK_ERR(split_gpuFree(ptr)); }
+
+   void* operator new[](size_t len) {
+      void* ptr;
+      SPLIT_CHECK_ERR(split_gpuMallocManaged(&ptr, len));
+      return ptr;
+   }
+
+   void operator delete[](void* ptr) { split_gpuFree(ptr); }
+#endif
+
+   HASHINATOR_HOSTDEVICE
+   uint32_t hash(KEY_TYPE in) const { return _map.hash(in); }
+
+   void rehash(int newSizePower) { _map.rehash(newSizePower); }
+
+   HASHINATOR_HOSTDEVICE
+   inline status peek_status(void) noexcept { return _map.peek_status(); }
+
+   HASHINATOR_HOSTDEVICE
+   inline int getSizePower(void) const noexcept { return _map.getSizePower(); }
+
+   HASHINATOR_HOSTDEVICE
+   size_t size() const { return _map.size(); }
+
+   HASHINATOR_HOSTDEVICE
+   size_t bucket_count() const { return _map.bucket_count(); }
+
+   HASHINATOR_HOSTDEVICE
+   constexpr KEY_TYPE get_emptybucket() const { return EMPTYBUCKET; }
+
+   HASHINATOR_HOSTDEVICE
+   constexpr KEY_TYPE get_tombstone() const { return TOMBSTONE; }
+
+   HASHINATOR_HOSTDEVICE
+   float load_factor() const { return _map.load_factor(); }
+
+   HASHINATOR_HOSTDEVICE
+   size_t tombstone_count() const { return _map.tombstone_count(); }
+
+   HASHINATOR_HOSTDEVICE
+   float tombstone_ratio() const { return _map.tombstone_ratio(); }
+
+   HASHINATOR_HOSTDEVICE
+   void stats() const { _map.stats(); }
+
+   void swap(Hashset& other) noexcept { _map.swap(other._map); }
+
+   // Empties the buckets in place, keeping their allocation and size
+   void clear() { _map.clear(); }
+
+   void resize(int newSizePower) { _map.resize(newSizePower); }
+
+   // Try to grow our buckets until we achieve a targetLF load factor
+   void resize_to_lf(float targetLF = 0.5) { _map.resize_to_lf(targetLF); }
+
+   // Try to get the overflow back to the original one and get rid of tombstones
+   void performCleanupTasks() { _map.performCleanupTasks(); }
+
+   // Inserts key. Returns true if it was not in the set already.
+   bool insert(const KEY_TYPE& key) {
+      const size_t fill = _map.size();
+      _map[key];
+      return _map.size() != fill;
+   }
+
+   bool contains(const KEY_TYPE& key) const { return _map.find(key) != _map.end(); }
+
+   size_t count(const KEY_TYPE& key) const { return _map.count(key); }
+
+   size_t erase(const KEY_TYPE& key) { return _map.erase(key); }
+
+   // Iterates through all valid keys. Keys cannot be modified in place.
+   class const_iterator {
+      typename map_type::const_iterator it;
+
+   public:
+      explicit const_iterator(typename map_type::const_iterator it) : it(it) {}
+      const_iterator& operator++() {
+         ++it;
+         return *this;
+      }
+      const_iterator operator++(int) { // Postfix version
+         const_iterator temp = *this;
+         ++(*this);
+         return temp;
+      }
+      bool operator==(const_iterator other) const { return it == other.it; }
+      bool operator!=(const_iterator other) const { return it != other.it; }
+      const KEY_TYPE& operator*() const { return it->first; }
+      const KEY_TYPE* operator->() const { return &it->first; }
+      size_t getIndex() { return it.getIndex(); }
+   };
+
+   const_iterator find(const KEY_TYPE& key) const { return const_iterator(_map.find(key)); }
+
+   const_iterator begin() const { return const_iterator(_map.begin()); }
+
+   const_iterator end() const { return const_iterator(_map.end()); }
+
+   // Dangerous methods for exposing internals
+   template <bool warn = true>
+   HASHINATOR_HOSTDEVICE MapInfo* expose_mapinfo() noexcept {
+      if constexpr (warn) {
+         printf("Warning, exposing Hashset internal info struct!\n");
+      }
+      return _map.template expose_mapinfo<false>();
+   }
+   template <bool warn = true>
+   HASHINATOR_HOSTDEVICE KEY_TYPE* expose_bucketdata() noexcept {
+      if constexpr (warn) {
+         printf("Warning, exposing Hashset internal bucket data!\n");
+      }
+      return &_map.template expose_bucketdata<false>()->first;
+   }
+
+#ifdef HASHINATOR_CPU_ONLY_MODE
+   // Grows once for the whole batch to reach targetLF, then inserts with the map's Hasher
+   void insert(const KEY_TYPE* keys, size_t len, float targetLF = 0.5) {
+      performCleanupTasks();
+      _map.insertIndex(const_cast<KEY_TYPE*>(keys), len, targetLF);
+   }
+
+   // found[i] is set to whether keys[i] is in the set, on the prefetched path of Hashmap::contains
+   template <int WINDOW = defaults::PREFETCH_WINDOW>
+   void contains(const KEY_TYPE* keys, bool* found, size_t len) {
+      std::vector<uint64_t> bitmask((len + 63) / 64);
+      _map.template contains<WINDOW>(keys, len, bitmask.data());
+      for (size_t i = 0; i < len; ++i) {
+         found[i] = (bitmask[i / 64] >> (i % 64)) & 1;
+      }
+   }
+
+   void erase(const KEY_TYPE* keys, size_t len) {
+      _map.erase(const_cast<KEY_TYPE*>(keys), len);
+      performCleanupTasks();
+   }
+
+   // Copies all keys to elements, in bucket order, and returns their number
+   size_t extractAllKeys(split::SplitVector<KEY_TYPE>& elements) const { return _map.extractAllKeys(elements); }
+#else
+   // Uses Hasher's insert_index_kernel to insert all keys
+   template <bool prefetches = true>
+   void insert(const KEY_TYPE* keys, size_t len, float targetLF = 0.5, split_gpuStream_t s = 0) {
+      _map.template insertIndex<prefetches>(const_cast<KEY_TYPE*>(keys), len, targetLF, s);
+      SPLIT_CHECK_ERR(split_gpuStreamSynchronize(s));
+   }
+
+   // Uses set_contains_kernel to look up all keys. found must be device accessible.
+   template <bool prefetches = true>
+   void contains(const KEY_TYPE* keys, bool* found, size_t len, split_gpuStream_t s = 0) {
+      if (len == 0) {
+         return;
+      }
+      Hashset* d_set = upload<prefetches>(s);
+      Hashers::set_contains_kernel<<<launchBlocks(len), defaults::MAX_BLOCKSIZE, 0, s>>>(d_set, keys, found, len);
+      SPLIT_CHECK_ERR(split_gpuStreamSynchronize(s));
+   }
+
+   // Uses Hasher's erase_kernel to delete all keys
+   template <bool prefetches = true>
+   void erase(const KEY_TYPE* keys, size_t len, split_gpuStream_t s = 0) {
+      if (len == 0) {
+         return;
+      }
+      _map.template erase<prefetches>(const_cast<KEY_TYPE*>(keys), len, s);
+      SPLIT_CHECK_ERR(split_gpuStreamSynchronize(s));
+   }
+
+   // Single stream compaction of the keys
+   template <bool prefetches = true>
+   size_t extractAllKeys(split::SplitVector<KEY_TYPE>& elements, split_gpuStream_t s = 0) {
+      return _map.template extractAllKeys<prefetches>(elements, s);
+   }
+
+   template <bool prefetches = true>
+   void device_rehash(int newSizePower, split_gpuStream_t s = 0) {
+      _map.template device_rehash<prefetches>(newSizePower, s);
+   }
+
+   /**
+    * Host function  that returns a device pointer that can be passed to kernels.
+    * The user **must** call download() after usage on device.
+    */
+   template <bool prefetches = true>
+   Hashset* upload(split_gpuStream_t stream = 0) {
+      if constexpr (prefetches) {
+         optimizeGPU(stream);
+      }
+      // The buckets of the map may have been reallocated since the last upload
+      SPLIT_CHECK_ERR(split_gpuMemcpyAsync(device_set, this, sizeof(Hashset), split_gpuMemcpyHostToDevice, stream));
+      return device_set;
+   }
+
+   // Brings the metadata back to host and rehashes if the device insertions overflowed or left tombstones
+   void download(split_gpuStream_t stream = 0) {
+      _map.download(stream);
+      SPLIT_CHECK_ERR(split_gpuStreamSynchronize(stream));
+   }
+
+   void optimizeGPU(split_gpuStream_t stream = 0) noexcept { _map.optimizeGPU(stream); }
+
+   /*Manually prefetch data on Host*/
+   void optimizeCPU(split_gpuStream_t stream = 0) noexcept { _map.optimizeCPU(stream); }
+
+   // Just return the device pointer. Upload should be called first
+   Hashset* get_device_pointer() { return device_set; }
+
+   // Device code for inserting keys. Returns true if the key was not in the set already.
+   HASHINATOR_DEVICEONLY
+   bool device_insert(const KEY_TYPE& key) { return _map.template set_element<true>(key, VAL_TYPE()); }
+
+   HASHINATOR_DEVICEONLY
+   bool device_contains(const KEY_TYPE& key) const { return _map.device_count(key) != 0; }
+
+   // Remove with tombstones on device
+   HASHINATOR_DEVICEONLY
+   size_t device_erase(const KEY_TYPE& key) { return _map.device_erase(key); }
+
+private:
+   static size_t launchBlocks(size_t len) {
+      // fast ceil for positive ints
+      return len / defaults::MAX_BLOCKSIZE + (len % defaults::MAX_BLOCKSIZE != 0);
+   }
+
+public:
+#endif
+};
+
+} // namespace Hashinator
@@ -751,5 +751,56 @@ __global__ void retrieve_kernel(hash_pair<KEY_TYPE, VAL_TYPE>* src, hash_pair<KE
    }
 }
 
+/*
+ * Sets the value of every empty bucket in dst to identity. Run before insert_reduce_kernel so that
+ * a reduction into a freshly claimed bucket always starts from the identity of the reducer.
+ * */
+template <typename KEY_TYPE, typename VAL_TYPE, KEY_TYPE EMPTYBUCKET = std::numeric_limits<KEY_TYPE>::max()>
+__global__ void reset_empty_values(hash_pair<KEY_TYPE, VAL_TYPE>* dst, const VAL_TYPE identity, const size_t len) {
+   const size_t tid = threadIdx.x + blockIdx.x * blockDim.x;
+   if (tid >= len) {
+      return;
+   }
+   if (dst[tid].first == EMPTYBUCKET) {
+      dst[tid].second = identity;
+   }
+}
+
+/*
+ * Inserts keys with one thread per element. Keys already in the buckets get their value combined
+ * with op, new keys are claimed in an empty bucket and reduced into its identity value.
+ * Tombstones are skipped, as in insert_kernel.
+ * */
+template <typename KEY_TYPE, typename VAL_TYPE, KEY_TYPE EMPTYBUCKET = std::numeric_limits<KEY_TYPE>::max(),
+          class HashFunction = HashFunctions::Fibonacci<KEY_TYPE>, int WARPSIZE = defaults::WARPSIZE,
+          int elementsPerWarp, class Op>
+__global__ void insert_reduce_kernel(KEY_TYPE* keys, VAL_TYPE* vals, hash_pair<KEY_TYPE, VAL_TYPE>* buckets,
+                                     Hashinator::Info* info, size_t len, Op op) {
+   const size_t tid = threadIdx.x + blockIdx.x * blockDim.x;
+   if (tid >= len) {
+      return;
+   }
+   const int sizePower = info->sizePower;
+   const int bitMask = (1 << (sizePower)) - 1;
+   const KEY_TYPE candidateKey = keys[tid];
+   const auto hashIndex = HashFunction::_hash(candidateKey, sizePower);
+
+   for (size_t i = 0; i < (1 << sizePower); i++) {
+      const size_t probingindex = ((hashIndex + i) & bitMask);
+      const KEY_TYPE old = split::s_atomicCAS(&buckets[probingindex].first, EMPTYBUCKET, candidateKey);
+      if (old == EMPTYBUCKET || old == candidateKey) {
+         Reducers::device_apply(&buckets[probingindex].second, vals[tid], op);
+         if (old == EMPTYBUCKET) {
+            split::s_atomicAdd(&info->fill, 1);
+         }
+         if (i + 1 > info->currentMaxBucketOverflow) {
+            split::s_atomicMax(&info->currentMaxBucketOverflow, nextOverflow(i + 1, WARPSIZE / elementsPerWarp));
+         }
+         return;
+      }
+   }
+   info->err = status::fail;
+}
+
 } // namespace Hashers
 } // namespace Hashinator
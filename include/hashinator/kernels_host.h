@@ -0,0 +1,369 @@
+/* File:    kernels_host.h
+ * Authors: Kostis Papadakis, Urs Ganse and Markus Battarbee (2023)
+ * Description: Host versions of the Hasher kernels for CPU only builds.
+ *              Chunks of split::tools::parallel_for take the place of blocks
+ *              and the lanes of a virtual warp are an unrolled loop per element.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ * */
+#pragma once
+#include "../common.h"
+#include "../splitvector/split_host_tools.h"
+#include "defaults.h"
+#include "hash_pair.h"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <utility>
+#ifdef __cpp_lib_atomic_ref
+namespace Hashinator {
+namespace Hashers {
+
+/*
+ * The kernels below follow kernels_NVIDIA.h step by step. A host thread runs a chunk of
+ * elements, one virtual warp after the other, and reduces fill and overflow locally before a
+ * single atomic update per chunk, like the shared memory reduction of a block. The warp votes
+ * are bitmasks built by a loop over the lanes; every lane reads its bucket with a relaxed atomic
+ * load and the winning lane claims it with a CAS, so concurrent chunks see the same races the
+ * device kernels handle. A host thread has no other warps to switch to while a probe misses the
+ * cache, so the elements are hashed a window ahead and their first buckets prefetched instead.
+ * */
+namespace host {
+
+// Elements per parallel_for chunk, the host counterpart of a block
+constexpr size_t BLOCK_ELEMENTS = defaults::MAX_BLOCKSIZE;
+
+template <typename T>
+inline T load(const T& ref) noexcept {
+   return std::atomic_ref<T>(const_cast<T&>(ref)).load(std::memory_order_relaxed);
+}
+
+template <typename T>
+inline void store(T& ref, const T& value) noexcept {
+   std::atomic_ref<T>(ref).store(value, std::memory_order_relaxed);
+}
+
+// Key only buckets have no value, the atomics above would write over their key
+inline KeyOnly load(const KeyOnly&) noexcept { return KeyOnly(); }
+
+inline void store(KeyOnly&, const KeyOnly&) noexcept {}
+
+template <typename T>
+inline bool cas(T& ref, T& expected, const T& desired) noexcept {
+   return std::atomic_ref<T>(ref).compare_exchange_strong(expected, desired, std::memory_order_relaxed);
+}
+
+inline void atomic_max(size_t& ref, size_t value) noexcept {
+   std::atomic_ref<size_t> target(ref);
+   size_t old = target.load(std::memory_order_relaxed);
+   while (old < value && !target.compare_exchange_weak(old, value, std::memory_order_relaxed)) {
+   }
+}
+
+// Ballot of the lanes of a virtual warp: bit l is set if lane l reads key at its bucket
+template <typename KEY_TYPE, typename VAL_TYPE, int VIRTUALWARP>
+inline uint32_t vote(const hash_pair<KEY_TYPE, VAL_TYPE>* buckets, size_t first, size_t bitMask,
+                     const KEY_TYPE& key) noexcept {
+   uint32_t mask = 0;
+   for (int lane = 0; lane < VIRTUALWARP; ++lane) {
+      mask |= uint32_t(load(buckets[(first + lane) & bitMask].first) == key) << lane;
+   }
+   return mask;
+}
+
+// Calls probe(i, hashIndex) for i in [begin,end) once the buckets of a window of elements are in flight
+template <typename KEY_TYPE, typename VAL_TYPE, class HashFunction, int VIRTUALWARP, class Key, class Probe>
+inline void for_each_window(const hash_pair<KEY_TYPE, VAL_TYPE>* buckets, int sizePower, size_t begin, size_t end,
+                            Key key, Probe probe) {
+   constexpr size_t WINDOW = defaults::PREFETCH_WINDOW;
+   const size_t bitMask = (size_t(1) << sizePower) - 1;
+   size_t home[WINDOW];
+   for (size_t base = begin; base < end; base += WINDOW) {
+      const size_t n = std::min(end - base, WINDOW);
+      for (size_t j = 0; j < n; ++j) {
+         home[j] = HashFunction::_hash(key(base + j), sizePower);
+         prefetch(&buckets[home[j]]);
+         prefetch(&buckets[(home[j] + VIRTUALWARP - 1) & bitMask]);
+      }
+      for (size_t j = 0; j < n; ++j) {
+         probe(base + j, home[j]);
+      }
+   }
+}
+
+/*
+ * One virtual warp inserting (key, val), the body of insert_kernel. Returns true if the key was
+ * placed, either in a bucket claimed from EMPTYBUCKET, which bumps added and overflow, or over
+ * an existing copy of the key. Tombstones are skipped, as on the device.
+ * */
+template <typename KEY_TYPE, typename VAL_TYPE, KEY_TYPE EMPTYBUCKET, class HashFunction, int VIRTUALWARP>
+inline bool warp_insert(hash_pair<KEY_TYPE, VAL_TYPE>* buckets, int sizePower, size_t hashIndex, const KEY_TYPE& key,
+                        const VAL_TYPE& val, size_t& added, size_t& overflow) noexcept {
+   const size_t nBuckets = size_t(1) << sizePower;
+   const size_t bitMask = nBuckets - 1;
+   for (size_t i = 0; i < nBuckets; i += VIRTUALWARP) {
+      // Empty buckets are voted for before existing keys, as in the device kernel
+      uint32_t mask = vote<KEY_TYPE, VAL_TYPE, VIRTUALWARP>(buckets, hashIndex + i, bitMask, EMPTYBUCKET);
+      const uint32_t alreadyExists = vote<KEY_TYPE, VAL_TYPE, VIRTUALWARP>(buckets, hashIndex + i, bitMask, key);
+      if (alreadyExists) {
+         const size_t winner = __builtin_ctz(alreadyExists);
+         store(buckets[(hashIndex + i + winner) & bitMask].second, val);
+         return true;
+      }
+      while (mask) {
+         const size_t winner = __builtin_ctz(mask);
+         hash_pair<KEY_TYPE, VAL_TYPE>& target = buckets[(hashIndex + i + winner) & bitMask];
+         KEY_TYPE old = EMPTYBUCKET;
+         if (cas(target.first, old, key)) {
+            store(target.second, val);
+            added++;
+            overflow = std::max(overflow, std::min(i + winner, nBuckets) + 1);
+            return true;
+         }
+         if (old == key) {
+            // Another chunk inserted the same key in between
+            store(target.second, val);
+            return true;
+         }
+         mask &= mask - 1;
+      }
+   }
+   return false;
+}
+
+// Runs warp_insert for every element of a batch and folds fill, overflow and err into info
+template <typename KEY_TYPE, typename VAL_TYPE, KEY_TYPE EMPTYBUCKET, class HashFunction, int VIRTUALWARP,
+          class Element>
+inline void insert_batch(hash_pair<KEY_TYPE, VAL_TYPE>* buckets, Hashinator::Info* info, size_t len,
+                         Element element) {
+   static_assert(VIRTUALWARP > 0 && VIRTUALWARP <= 32, "Host virtual warps vote into 32 bit masks");
+   const int sizePower = info->sizePower;
+   split::tools::parallel_for(
+       len,
+       [&](size_t begin, size_t end, size_t) {
+          size_t blockTotal = 0;
+          size_t blockOverflow = 0;
+          bool blockDone = true;
+          for_each_window<KEY_TYPE, VAL_TYPE, HashFunction, VIRTUALWARP>(
+              buckets, sizePower, begin, end, [&](size_t wid) { return element(wid).first; },
+              [&](size_t wid, size_t hashIndex) {
+                 const hash_pair<KEY_TYPE, VAL_TYPE> candidate = element(wid);
+                 blockDone &= warp_insert<KEY_TYPE, VAL_TYPE, EMPTYBUCKET, HashFunction, VIRTUALWARP>(
+                     buckets, sizePower, hashIndex, candidate.first, candidate.second, blockTotal, blockOverflow);
+              });
+          atomic_max(info->currentMaxBucketOverflow, nextOverflow(blockOverflow, VIRTUALWARP));
+          std::atomic_ref<size_t>(info->fill).fetch_add(blockTotal, std::memory_order_relaxed);
+          if (!blockDone) {
+             store(info->err, status::fail);
+          }
+       },
+       BLOCK_ELEMENTS);
+}
+
+/*
+ * Looks up every element of a batch, the body of retrieve_kernel. Probes until an EMPTYBUCKET
+ * rather than currentMaxBucketOverflow, since the serial host inserts do not track the overflow.
+ * */
+template <typename KEY_TYPE, typename VAL_TYPE, KEY_TYPE EMPTYBUCKET, class HashFunction, int VIRTUALWARP,
+          class Element>
+inline void retrieve_batch(hash_pair<KEY_TYPE, VAL_TYPE>* buckets, Hashinator::Info* info, size_t len,
+                           Element element) {
+   const int sizePower = info->sizePower;
+   const size_t nBuckets = size_t(1) << sizePower;
+   const size_t bitMask = nBuckets - 1;
+   split::tools::parallel_for(
+       len,
+       [&](size_t begin, size_t end, size_t) {
+          for_each_window<KEY_TYPE, VAL_TYPE, HashFunction, VIRTUALWARP>(
+              buckets, sizePower, begin, end, [&](size_t wid) { return element(wid).first; },
+              [&](size_t wid, size_t hashIndex) {
+                 std::pair<const KEY_TYPE&, VAL_TYPE&> candidate = element(wid);
+                 for (size_t i = 0; i < nBuckets; i += VIRTUALWARP) {
+                    const uint32_t maskExists =
+                        vote<KEY_TYPE, VAL_TYPE, VIRTUALWARP>(buckets, hashIndex + i, bitMask, candidate.first);
+                    if (maskExists) {
+                       const size_t winner = __builtin_ctz(maskExists);
+                       candidate.second = load(buckets[(hashIndex + i + winner) & bitMask].second);
+                       return;
+                    }
+                    if (vote<KEY_TYPE, VAL_TYPE, VIRTUALWARP>(buckets, hashIndex + i, bitMask, EMPTYBUCKET)) {
+                       return;
+                    }
+                 }
+              });
+       },
+       BLOCK_ELEMENTS);
+}
+
+} // namespace host
+
+/*
+ * Resets all elements in dst to EMPTY, VAL_TYPE()
+ * */
+template <typename KEY_TYPE, typename VAL_TYPE, KEY_TYPE EMPTYBUCKET = std::numeric_limits<KEY_TYPE>::max()>
+void reset_all_to_empty(hash_pair<KEY_TYPE, VAL_TYPE>* dst, Hashinator::Info* info, const size_t len) {
+   split::tools::parallel_for(
+       len,
+       [dst](size_t begin, size_t end, size_t) {
+          for (size_t i = begin; i < end; ++i) {
+             dst[i].first = EMPTYBUCKET;
+          }
+       },
+       1ul << 16);
+   info->fill = 0;
+}
+
+/*
+ * Resets all elements pointed by src to EMPTY in dst
+ * If an elements in src is not found this will assert(false)
+ * */
+template <typename KEY_TYPE, typename VAL_TYPE, KEY_TYPE EMPTYBUCKET = std::numeric_limits<KEY_TYPE>::max(),
+          class HashFunction = HashFunctions::Fibonacci<KEY_TYPE>, int WARPSIZE = defaults::WARPSIZE,
+          int elementsPerWarp>
+void reset_to_empty(hash_pair<KEY_TYPE, VAL_TYPE>* src, hash_pair<KEY_TYPE, VAL_TYPE>* dst,
+                    Hashinator::Info* info, size_t len) {
+   constexpr int VIRTUALWARP = WARPSIZE / elementsPerWarp;
+   const int sizePower = info->sizePower;
+   const size_t nBuckets = size_t(1) << sizePower;
+   const size_t bitMask = nBuckets - 1;
+   info->fill -= len;
+   split::tools::parallel_for(
+       len,
+       [&](size_t begin, size_t end, size_t) {
+          for (size_t wid = begin; wid < end; ++wid) {
+             const KEY_TYPE key = src[wid].first;
+             const size_t hashIndex = HashFunction::_hash(key, sizePower);
+             bool vWarpDone = false;
+             for (size_t i = 0; i < nBuckets && !vWarpDone; i += VIRTUALWARP) {
+                const uint32_t mask = host::vote<KEY_TYPE, VAL_TYPE, VIRTUALWARP>(dst, hashIndex + i, bitMask, key);
+                if (mask) {
+                   host::store(dst[(hashIndex + i + __builtin_ctz(mask)) & bitMask].first, EMPTYBUCKET);
+                   vWarpDone = true;
+                }
+             }
+             assert(vWarpDone && "Element to reset not found");
+          }
+       },
+       host::BLOCK_ELEMENTS);
+}
+
+/*Host version of the warp synchronous hashing kernel, see kernels_NVIDIA.h.
+ * Every virtual warp probes VIRTUALWARP buckets per step, votes for empty
+ * buckets and existing copies of its key and lets the first lane with a
+ * hit claim or overwrite it. Sets info->err to fail if some element did
+ * not fit in the whole table.
+ * */
+template <typename KEY_TYPE, typename VAL_TYPE, KEY_TYPE EMPTYBUCKET = std::numeric_limits<KEY_TYPE>::max(),
+          class HashFunction = HashFunctions::Fibonacci<KEY_TYPE>, int WARPSIZE = defaults::WARPSIZE,
+          int elementsPerWarp>
+void insert_kernel(hash_pair<KEY_TYPE, VAL_TYPE>* src, hash_pair<KEY_TYPE, VAL_TYPE>* buckets,
+                   Hashinator::Info* info, size_t len) {
+   host::insert_batch<KEY_TYPE, VAL_TYPE, EMPTYBUCKET, HashFunction, WARPSIZE / elementsPerWarp>(
+       buckets, info, len, [src](size_t i) { return src[i]; });
+}
+
+template <typename KEY_TYPE, typename VAL_TYPE, KEY_TYPE EMPTYBUCKET = std::numeric_limits<KEY_TYPE>::max(),
+          class HashFunction = HashFunctions::Fibonacci<KEY_TYPE>, int WARPSIZE = defaults::WARPSIZE,
+          int elementsPerWarp>
+void insert_kernel(KEY_TYPE* keys, VAL_TYPE* vals, hash_pair<KEY_TYPE, VAL_TYPE>* buckets,
+                   Hashinator::Info* info, size_t len) {
+   host::insert_batch<KEY_TYPE, VAL_TYPE, EMPTYBUCKET, HashFunction, WARPSIZE / elementsPerWarp>(
+       buckets, info, len, [keys, vals](size_t i) { return hash_pair<KEY_TYPE, VAL_TYPE>(keys[i], vals[i]); });
+}
+
+// Same as insert_kernel with the index of every key as its value
+template <typename KEY_TYPE, typename VAL_TYPE, KEY_TYPE EMPTYBUCKET = std::numeric_limits<KEY_TYPE>::max(),
+          class HashFunction = HashFunctions::Fibonacci<KEY_TYPE>, int WARPSIZE = defaults::WARPSIZE,
+          int elementsPerWarp>
+void insert_index_kernel(KEY_TYPE* keys, hash_pair<KEY_TYPE, VAL_TYPE>* buckets, Hashinator::Info* info,
+                         size_t len) {
+   host::insert_batch<KEY_TYPE, VAL_TYPE, EMPTYBUCKET, HashFunction, WARPSIZE / elementsPerWarp>(
+       buckets, info, len, [keys](size_t i) { return hash_pair<KEY_TYPE, VAL_TYPE>(keys[i], VAL_TYPE(i)); });
+}
+
+/*
+ * In a similar way to the insert and retrieve kernels we
+ * delete keys in "keys" if they do exist in the hasmap.
+ * If the keys do not exist we do nothing. Like retrieve
+ * we probe until an EMPTYBUCKET, as operator[] and the
+ * other serial host inserts may place keys further than
+ * currentMaxBucketOverflow.
+ * */
+template <typename KEY_TYPE, typename VAL_TYPE, KEY_TYPE EMPTYBUCKET = std::numeric_limits<KEY_TYPE>::max(),
+          KEY_TYPE TOMBSTONE = EMPTYBUCKET - 1, class HashFunction = HashFunctions::Fibonacci<KEY_TYPE>,
+          int WARPSIZE = defaults::WARPSIZE, int elementsPerWarp>
+void delete_kernel(KEY_TYPE* keys, hash_pair<KEY_TYPE, VAL_TYPE>* buckets, Hashinator::Info* info, size_t len) {
+   constexpr int VIRTUALWARP = WARPSIZE / elementsPerWarp;
+   const int sizePower = info->sizePower;
+   const size_t nBuckets = size_t(1) << sizePower;
+   const size_t bitMask = nBuckets - 1;
+   split::tools::parallel_for(
+       len,
+       [&](size_t begin, size_t end, size_t) {
+          size_t blockTotal = 0;
+          host::for_each_window<KEY_TYPE, VAL_TYPE, HashFunction, VIRTUALWARP>(
+              buckets, sizePower, begin, end, [keys](size_t wid) { return keys[wid]; },
+              [&](size_t wid, size_t hashIndex) {
+                 const KEY_TYPE key = keys[wid];
+                 for (size_t i = 0; i < nBuckets; i += VIRTUALWARP) {
+                    const uint32_t maskExists =
+                        host::vote<KEY_TYPE, VAL_TYPE, VIRTUALWARP>(buckets, hashIndex + i, bitMask, key);
+                    if (maskExists) {
+                       // A CAS rather than an exchange, so a key repeated in the batch is only counted once
+                       KEY_TYPE expected = key;
+                       const size_t winner = __builtin_ctz(maskExists);
+                       blockTotal += host::cas(buckets[(hashIndex + i + winner) & bitMask].first, expected, TOMBSTONE);
+                       return;
+                    }
+                    // If we encountered empty and the key is not in the range of this warp that means the key is
+                    // not in hashmap.
+                    if (host::vote<KEY_TYPE, VAL_TYPE, VIRTUALWARP>(buckets, hashIndex + i, bitMask, EMPTYBUCKET)) {
+                       return;
+                    }
+                 }
+              });
+          std::atomic_ref<size_t>(info->tombstoneCounter).fetch_add(blockTotal, std::memory_order_relaxed);
+       },
+       host::BLOCK_ELEMENTS);
+}
+
+/*
+ * Similarly to the insert_kernel we examine elements in keys and return their value in vals,
+ * if the do exist in the hashmap. Values of keys that are not found are left untouched.
+ * */
+template <typename KEY_TYPE, typename VAL_TYPE, KEY_TYPE EMPTYBUCKET = std::numeric_limits<KEY_TYPE>::max(),
+          class HashFunction = HashFunctions::Fibonacci<KEY_TYPE>, int WARPSIZE = defaults::WARPSIZE,
+          int elementsPerWarp>
+void retrieve_kernel(KEY_TYPE* keys, VAL_TYPE* vals, hash_pair<KEY_TYPE, VAL_TYPE>* buckets,
+                     Hashinator::Info* info, size_t len) {
+   host::retrieve_batch<KEY_TYPE, VAL_TYPE, EMPTYBUCKET, HashFunction, WARPSIZE / elementsPerWarp>(
+       buckets, info, len,
+       [keys, vals](size_t i) { return std::pair<const KEY_TYPE&, VAL_TYPE&>(keys[i], vals[i]); });
+}
+
+template <typename KEY_TYPE, typename VAL_TYPE, KEY_TYPE EMPTYBUCKET = std::numeric_limits<KEY_TYPE>::max(),
+          class HashFunction = HashFunctions::Fibonacci<KEY_TYPE>, int WARPSIZE = defaults::WARPSIZE,
+          int elementsPerWarp>
+void retrieve_kernel(hash_pair<KEY_TYPE, VAL_TYPE>* src, hash_pair<KEY_TYPE, VAL_TYPE>* buckets,
+                     Hashinator::Info* info, size_t len) {
+   host::retrieve_batch<KEY_TYPE, VAL_TYPE, EMPTYBUCKET, HashFunction, WARPSIZE / elementsPerWarp>(
+       buckets, info, len,
+       [src](size_t i) { return std::pair<const KEY_TYPE&, VAL_TYPE&>(src[i].first, src[i].second); });
+}
+
+} // namespace Hashers
+} // namespace Hashinator
+#endif
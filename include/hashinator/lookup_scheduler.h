@@ -0,0 +1,140 @@
+/* File:    lookup_scheduler.h
+ * Authors: Kostis Papadakis, Urs Ganse and Markus Battarbee (2023)
+ * Description: Coroutine task and scheduler used to interleave
+ *              independent host lookups into Hashinator.
+ *
+ * This file defines the following classes:
+ *    --Hashinator::LookupTask;
+ *    --Hashinator::LookupScheduler;
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ * */
+#pragma once
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <vector>
+
+namespace Hashinator {
+
+class LookupScheduler;
+
+/**
+ * @brief Coroutine type for code that performs interleaved lookups.
+ *
+ * A LookupTask is created suspended and only starts running once handed to a LookupScheduler.
+ * Inside it, `co_await hmap.async_find(key)` prefetches the home bucket of key and yields to the
+ * other tasks of the scheduler, so that the memory latency of independent lookups overlaps.
+ *
+ * Example Usage:
+ *
+ *    LookupTask lookup(Hashmap<uint32_t,uint32_t>& hmap, uint32_t* keys, size_t n, size_t& hits){
+ *       for (size_t i = 0; i < n; ++i) {
+ *          auto it = co_await hmap.async_find(keys[i]);
+ *          hits += (it != hmap.end());
+ *       }
+ *    }
+ *
+ *    LookupScheduler scheduler;
+ *    for (...) { scheduler.spawn(lookup(hmap, ...)); }
+ *    scheduler.run();
+ */
+class LookupTask {
+public:
+   struct promise_type {
+      LookupScheduler* scheduler = nullptr;
+      std::exception_ptr exception = nullptr;
+
+      LookupTask get_return_object() noexcept {
+         return LookupTask(std::coroutine_handle<promise_type>::from_promise(*this));
+      }
+      std::suspend_always initial_suspend() const noexcept { return {}; }
+      std::suspend_always final_suspend() const noexcept { return {}; }
+      void return_void() const noexcept {}
+      void unhandled_exception() noexcept { exception = std::current_exception(); }
+   };
+   using handle_type = std::coroutine_handle<promise_type>;
+
+   LookupTask(LookupTask&& other) noexcept : handle(other.handle) { other.handle = nullptr; }
+   LookupTask(const LookupTask&) = delete;
+   LookupTask& operator=(const LookupTask&) = delete;
+   LookupTask& operator=(LookupTask&& other) noexcept {
+      if (this != &other) {
+         if (handle) {
+            handle.destroy();
+         }
+         handle = other.handle;
+         other.handle = nullptr;
+      }
+      return *this;
+   }
+   ~LookupTask() {
+      if (handle) {
+         handle.destroy();
+      }
+   }
+
+private:
+   friend class LookupScheduler;
+   explicit LookupTask(handle_type h) noexcept : handle(h) {}
+   handle_type handle;
+};
+
+/**
+ * @brief Round-robin scheduler for LookupTasks.
+ *
+ * Tasks suspended in an async lookup are resumed in FIFO order, so with N tasks spawned up to N
+ * home buckets are in flight at any time. The scheduler is single threaded; use one per thread.
+ */
+class LookupScheduler {
+public:
+   LookupScheduler() = default;
+   LookupScheduler(const LookupScheduler&) = delete;
+   LookupScheduler& operator=(const LookupScheduler&) = delete;
+
+   // Takes ownership of task. It will start running on the next call to run()
+   void spawn(LookupTask task) {
+      task.handle.promise().scheduler = this;
+      ready.push_back(task.handle);
+      tasks.push_back(std::move(task));
+   }
+
+   // Used by the awaiters to requeue a suspended task
+   void schedule(std::coroutine_handle<> h) { ready.push_back(h); }
+
+   // Resumes tasks until all of them have completed. Exceptions thrown inside a task are rethrown here.
+   void run() {
+      while (!ready.empty()) {
+         std::coroutine_handle<> h = ready.front();
+         ready.pop_front();
+         h.resume();
+      }
+      std::vector<LookupTask> finished = std::move(tasks);
+      tasks.clear();
+      for (auto& task : finished) {
+         if (task.handle.promise().exception) {
+            std::rethrow_exception(task.handle.promise().exception);
+         }
+      }
+   }
+
+   size_t pending() const noexcept { return ready.size(); }
+
+private:
+   std::deque<std::coroutine_handle<>> ready;
+   std::vector<LookupTask> tasks;
+};
+
+} // namespace Hashinator
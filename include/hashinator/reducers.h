@@ -0,0 +1,105 @@
+/* File:    reducers.h
+ * Authors: Kostis Papadakis, Urs Ganse and Markus Battarbee (2023)
+ * Description: Reduction operators used by Hashmap::insert_reduce to
+ *              combine values of keys that are already in the map.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ * */
+#pragma once
+#include "../common.h"
+#include <atomic>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#ifndef HASHINATOR_CPU_ONLY_MODE
+#include "../splitvector/gpu_wrappers.h"
+#endif
+
+namespace Hashinator {
+namespace Reducers {
+
+/*
+ * A reducer is any type providing
+ *    static T identity();          the value new keys start from
+ *    T operator()(T old, T val);   associative and commutative combination
+ * Add, Min and Max of integers map onto native atomics, everything else goes through a CAS loop.
+ */
+template <typename T>
+struct Add {
+   HASHINATOR_HOSTDEVICE static constexpr T identity() noexcept { return T(0); }
+   HASHINATOR_HOSTDEVICE constexpr T operator()(const T& a, const T& b) const noexcept { return a + b; }
+};
+
+template <typename T>
+struct Min {
+   HASHINATOR_HOSTDEVICE static constexpr T identity() noexcept { return std::numeric_limits<T>::max(); }
+   HASHINATOR_HOSTDEVICE constexpr T operator()(const T& a, const T& b) const noexcept { return b < a ? b : a; }
+};
+
+template <typename T>
+struct Max {
+   HASHINATOR_HOSTDEVICE static constexpr T identity() noexcept { return std::numeric_limits<T>::lowest(); }
+   HASHINATOR_HOSTDEVICE constexpr T operator()(const T& a, const T& b) const noexcept { return a < b ? b : a; }
+};
+
+#ifdef __cpp_lib_atomic_ref
+// Atomically replaces *address with op(*address, value) from a host thread
+template <typename T, typename Op>
+inline void host_apply(T* address, const T& value, Op op) noexcept {
+   std::atomic_ref<T> ref(*address);
+   if constexpr (std::is_same<Op, Add<T>>::value && std::is_integral<T>::value) {
+      ref.fetch_add(value, std::memory_order_relaxed);
+   } else {
+      T old = ref.load(std::memory_order_relaxed);
+      while (!ref.compare_exchange_weak(old, op(old, value), std::memory_order_relaxed)) {
+      }
+   }
+}
+#endif
+
+#ifndef HASHINATOR_CPU_ONLY_MODE
+// Atomically replaces *address with op(*address, value) from a device thread
+template <typename T, typename Op>
+__device__ __forceinline__ void device_apply(T* address, const T& value, Op op) noexcept {
+   constexpr bool integral = std::is_integral<T>::value;
+   if constexpr (integral && std::is_same<Op, Add<T>>::value) {
+      split::s_atomicAdd(address, value);
+   } else if constexpr (integral && std::is_same<Op, Min<T>>::value) {
+      split::s_atomicMin(address, value);
+   } else if constexpr (integral && std::is_same<Op, Max<T>>::value) {
+      split::s_atomicMax(address, value);
+   } else {
+      // The CAS works on the bit pattern, so floating point and other trivially copyable values
+      // of 4 or 8 bytes are supported too
+      static_assert(sizeof(T) == 4 || sizeof(T) == 8, "device_apply needs a 4 or 8 byte value type");
+      using Bits = typename std::conditional<sizeof(T) == 4, unsigned int, unsigned long long>::type;
+      Bits* bits = reinterpret_cast<Bits*>(address);
+      Bits old = *bits;
+      Bits assumed;
+      do {
+         assumed = old;
+         T current;
+         memcpy(&current, &assumed, sizeof(T));
+         const T next = op(current, value);
+         Bits nextBits;
+         memcpy(&nextBits, &next, sizeof(T));
+         old = split::s_atomicCAS(bits, assumed, nextBits);
+      } while (assumed != old);
+   }
+}
+#endif
+
+} // namespace Reducers
+} // namespace Hashinator
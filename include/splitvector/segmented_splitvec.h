@@ -0,0 +1,419 @@
+/* File:    segmented_splitvec.h
+ * Authors: Kostis Papadakis (2023)
+ * Description: A chunked vector that grows without relocating its elements
+ *
+ * This file defines the following classes or functions:
+ *    --split::SegmentedSplitVector
+ *    --split::tools::copy_if
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ * */
+#pragma once
+#include "split_host_tools.h"
+#include "splitvec.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace split {
+
+/**
+ * @brief A host vector stored in fixed size chunks that never move.
+ *
+ * Elements live in chunks of 2^CHUNK_POWER elements that are reached through a directory of
+ * maxChunks pointers allocated once at construction, so indexing is a shift and a mask and
+ * growing only ever adds chunks. Element addresses stay valid until the element is erased or the
+ * vector is destroyed, and growth never needs twice the memory of the vector.
+ *
+ * Several threads can append at the same time through their own Appender. An Appender claims
+ * whole chunks and fills them without synchronization; once all Appenders of a phase are gone,
+ * seal() moves the elements of the partially filled chunks into the holes so that [0, size())
+ * is dense again. Only seal() relocates elements, and at most one chunk per Appender.
+ *
+ * Example Usage:
+ *
+ *    SegmentedSplitVector<int> out;
+ *    split::tools::parallel_for(n, [&](size_t begin, size_t end, size_t) {
+ *       auto appender = out.appender();
+ *       for (size_t i = begin; i < end; ++i) { if (keep(i)) { appender.push_back(i); } }
+ *    });
+ *    out.seal();
+ */
+template <typename T, class Allocator = DefaultAllocator<T>, int CHUNK_POWER = 16>
+class SegmentedSplitVector {
+   static_assert(CHUNK_POWER > 0 && CHUNK_POWER < 32);
+
+public:
+   static constexpr size_t CHUNK = size_t(1) << CHUNK_POWER;
+   static constexpr size_t MASK = CHUNK - 1;
+
+   /**
+    * @brief Random access iterator over the elements, by index.
+    */
+   template <bool CONST>
+   class basic_iterator {
+      using vec_type = std::conditional_t<CONST, const SegmentedSplitVector, SegmentedSplitVector>;
+      vec_type* _vec;
+      size_t _index;
+
+   public:
+      using iterator_category = std::random_access_iterator_tag;
+      using value_type = T;
+      using difference_type = int64_t;
+      using pointer = std::conditional_t<CONST, const T*, T*>;
+      using reference = std::conditional_t<CONST, const T&, T&>;
+
+      basic_iterator(vec_type* vec, size_t index) : _vec(vec), _index(index) {}
+
+      reference operator*() const { return (*_vec)[_index]; }
+      pointer operator->() const { return &(*_vec)[_index]; }
+      reference operator[](difference_type offset) const { return (*_vec)[_index + offset]; }
+      size_t index() const noexcept { return _index; }
+
+      bool operator==(const basic_iterator& other) const { return _index == other._index; }
+      bool operator!=(const basic_iterator& other) const { return _index != other._index; }
+      bool operator<(const basic_iterator& other) const { return _index < other._index; }
+      basic_iterator& operator++() {
+         ++_index;
+         return *this;
+      }
+      basic_iterator operator++(int) {
+         basic_iterator old(*this);
+         ++_index;
+         return old;
+      }
+      basic_iterator& operator--() {
+         --_index;
+         return *this;
+      }
+      basic_iterator operator--(int) {
+         basic_iterator old(*this);
+         --_index;
+         return old;
+      }
+      basic_iterator& operator+=(difference_type offset) {
+         _index += offset;
+         return *this;
+      }
+      basic_iterator& operator-=(difference_type offset) {
+         _index -= offset;
+         return *this;
+      }
+      basic_iterator operator+(difference_type offset) const { return basic_iterator(_vec, _index + offset); }
+      basic_iterator operator-(difference_type offset) const { return basic_iterator(_vec, _index - offset); }
+      difference_type operator-(const basic_iterator& other) const {
+         return static_cast<difference_type>(_index) - static_cast<difference_type>(other._index);
+      }
+   };
+
+   using iterator = basic_iterator<false>;
+   using const_iterator = basic_iterator<true>;
+
+   /**
+    * @brief Per thread handle for parallel appends, see the class description.
+    */
+   class Appender {
+      SegmentedSplitVector* _vec;
+      size_t _chunk = 0;
+      size_t _fill = CHUNK; // full, so the first push_back claims a chunk
+
+   public:
+      explicit Appender(SegmentedSplitVector* vec) : _vec(vec) {}
+      Appender(Appender&& other) noexcept : _vec(other._vec), _chunk(other._chunk), _fill(other._fill) {
+         other._fill = CHUNK;
+      }
+      Appender(const Appender&) = delete;
+      Appender& operator=(const Appender&) = delete;
+      Appender& operator=(Appender&&) = delete;
+      ~Appender() { flush(); }
+
+      void push_back(const T& value) {
+         if (_fill == CHUNK) {
+            _chunk = _vec->_claim_chunk();
+            _fill = 0;
+         }
+         _vec->_directory[_chunk][_fill++] = value;
+      }
+
+      // Hands the current chunk back to the vector. Called by the destructor.
+      void flush() {
+         if (_fill < CHUNK) {
+            _vec->_add_partial(_chunk, _fill);
+            _fill = CHUNK;
+         }
+      }
+   };
+
+   // The directory holds maxChunks chunks, which bounds max_size()
+   static constexpr size_t DEFAULT_MAX_CHUNKS = 4096;
+
+   SegmentedSplitVector() : _directory(DEFAULT_MAX_CHUNKS, nullptr) {}
+
+   explicit SegmentedSplitVector(size_t size, const T& val = T(), size_t maxChunks = DEFAULT_MAX_CHUNKS)
+       : _directory(maxChunks, nullptr) {
+      resize(size);
+      for (size_t i = 0; i < size; ++i) {
+         (*this)[i] = val;
+      }
+   }
+
+   SegmentedSplitVector(const SegmentedSplitVector& other) : _directory(other._directory.size(), nullptr) {
+      *this = other;
+   }
+
+   // other is left empty, without a directory
+   SegmentedSplitVector(SegmentedSplitVector&& other) noexcept { swap(other); }
+
+   SegmentedSplitVector& operator=(const SegmentedSplitVector& other) {
+      if (this == &other) {
+         return *this;
+      }
+      if (other.size() > max_size()) {
+         throw std::length_error("SegmentedSplitVector directory too small");
+      }
+      resize(other.size());
+      for (size_t c = 0; c * CHUNK < other.size(); ++c) {
+         const size_t n = std::min(CHUNK, other.size() - c * CHUNK);
+         std::copy(other._directory[c], other._directory[c] + n, _directory[c]);
+      }
+      return *this;
+   }
+
+   SegmentedSplitVector& operator=(SegmentedSplitVector&& other) noexcept {
+      swap(other);
+      return *this;
+   }
+
+   ~SegmentedSplitVector() {
+      for (size_t c = 0; c < _directory.size(); ++c) {
+         if (_directory[c] != nullptr) {
+            for (size_t i = 0; i < CHUNK; ++i) {
+               _allocator.destroy(&_directory[c][i]);
+            }
+            _allocator.deallocate(_directory[c], CHUNK);
+         }
+      }
+   }
+
+   void swap(SegmentedSplitVector& other) noexcept {
+      _directory.swap(other._directory);
+      std::swap(_size, other._size);
+      const size_t chunks = _usedChunks.load(std::memory_order_relaxed);
+      _usedChunks.store(other._usedChunks.load(std::memory_order_relaxed), std::memory_order_relaxed);
+      other._usedChunks.store(chunks, std::memory_order_relaxed);
+      const size_t allocated = _allocatedChunks.load(std::memory_order_relaxed);
+      _allocatedChunks.store(other._allocatedChunks.load(std::memory_order_relaxed), std::memory_order_relaxed);
+      other._allocatedChunks.store(allocated, std::memory_order_relaxed);
+      _partials.swap(other._partials);
+   }
+
+   size_t size() const noexcept { return _size; }
+   bool empty() const noexcept { return _size == 0; }
+   size_t capacity() const noexcept { return _allocatedChunks.load(std::memory_order_relaxed) * CHUNK; }
+   size_t max_size() const noexcept { return _directory.size() * CHUNK; }
+   static constexpr size_t chunk_size() noexcept { return CHUNK; }
+
+   T& operator[](size_t index) noexcept { return _directory[index >> CHUNK_POWER][index & MASK]; }
+   const T& operator[](size_t index) const noexcept { return _directory[index >> CHUNK_POWER][index & MASK]; }
+
+   T& at(size_t index) {
+      _rangeCheck(index);
+      return (*this)[index];
+   }
+   const T& at(size_t index) const {
+      _rangeCheck(index);
+      return (*this)[index];
+   }
+
+   T& back() noexcept { return (*this)[_size - 1]; }
+   const T& back() const noexcept { return (*this)[_size - 1]; }
+
+   // Contiguous storage of chunk c
+   T* chunk(size_t c) noexcept { return _directory[c]; }
+   const T* chunk(size_t c) const noexcept { return _directory[c]; }
+
+   iterator begin() noexcept { return iterator(this, 0); }
+   iterator end() noexcept { return iterator(this, _size); }
+   const_iterator begin() const noexcept { return const_iterator(this, 0); }
+   const_iterator end() const noexcept { return const_iterator(this, _size); }
+
+   // Allocates chunks for at least requested elements. Existing elements never move.
+   void reserve(size_t requested) {
+      if (requested > max_size()) {
+         throw std::length_error("SegmentedSplitVector directory too small");
+      }
+      for (size_t c = 0; c * CHUNK < requested; ++c) {
+         _ensure_chunk(c);
+      }
+   }
+
+   // Changes the size, keeping the chunks of elements that are dropped for later reuse
+   void resize(size_t newSize) {
+      reserve(newSize);
+      _size = newSize;
+      _usedChunks.store((newSize + MASK) >> CHUNK_POWER, std::memory_order_relaxed);
+   }
+
+   void clear() noexcept {
+      _size = 0;
+      _usedChunks.store(0, std::memory_order_relaxed);
+   }
+
+   void push_back(const T& value) {
+      if ((_size & MASK) == 0) {
+         if (_size == max_size()) {
+            throw std::length_error("SegmentedSplitVector directory too small");
+         }
+         _ensure_chunk(_size >> CHUNK_POWER);
+         _usedChunks.store((_size >> CHUNK_POWER) + 1, std::memory_order_relaxed);
+      }
+      (*this)[_size++] = value;
+   }
+
+   void pop_back() noexcept {
+      --_size;
+      _usedChunks.store((_size + MASK) >> CHUNK_POWER, std::memory_order_relaxed);
+   }
+
+   // Starts a parallel append phase for the calling thread. Serial members must not run meanwhile.
+   Appender appender() { return Appender(this); }
+
+   /**
+    * @brief Ends a parallel append phase.
+    *
+    * The chunks claimed by Appenders, and the last chunk of the vector before the phase, may be
+    * only partially filled. Elements from the highest positions are moved into the holes until
+    * all of [0, size()) is filled. The order of elements appended in parallel is unspecified.
+    */
+   void seal() {
+      const size_t nChunks = _usedChunks.load(std::memory_order_relaxed);
+      std::vector<size_t> fill(nChunks, CHUNK);
+      if ((_size & MASK) != 0) {
+         fill[_size >> CHUNK_POWER] = _size & MASK;
+      }
+      for (const auto& p : _partials) {
+         fill[p.first] = p.second;
+      }
+      _partials.clear();
+      size_t total = 0;
+      for (size_t c = 0; c < nChunks; ++c) {
+         total += fill[c];
+      }
+
+      // There are as many holes below total as elements at or above it, and walking down from the
+      // last element visits exactly those elements before any element below total.
+      size_t src = nChunks;
+      size_t srcFill = 0;
+      for (size_t c = 0; c * CHUNK < total; ++c) {
+         for (size_t hole = c * CHUNK + fill[c]; hole < std::min((c + 1) * CHUNK, total); ++hole) {
+            while (srcFill == 0) {
+               srcFill = fill[--src];
+            }
+            (*this)[hole] = std::move((*this)[src * CHUNK + --srcFill]);
+         }
+      }
+      _size = total;
+      _usedChunks.store((total + MASK) >> CHUNK_POWER, std::memory_order_relaxed);
+   }
+
+private:
+   std::vector<T*> _directory; // fixed size, entries are allocated on first use
+   size_t _size = 0;
+   std::atomic<size_t> _usedChunks{0};      // chunks holding elements or claimed by an Appender
+   std::atomic<size_t> _allocatedChunks{0}; // chunks with storage
+   std::vector<std::pair<size_t, size_t>> _partials; // chunk and fill of chunks Appenders left
+   std::mutex _partialsLock;
+   Allocator _allocator;
+
+   void _rangeCheck(size_t index) const {
+      if (index >= _size) {
+         throw std::out_of_range("SegmentedSplitVector index out of range");
+      }
+   }
+
+   void _ensure_chunk(size_t c) {
+      if (_directory[c] != nullptr) {
+         return;
+      }
+      T* data = _allocator.allocate(CHUNK);
+      for (size_t i = 0; i < CHUNK; ++i) {
+         _allocator.construct(&data[i], T());
+      }
+      _directory[c] = data;
+      _allocatedChunks.fetch_add(1, std::memory_order_relaxed);
+   }
+
+   size_t _claim_chunk() {
+      const size_t c = _usedChunks.fetch_add(1, std::memory_order_relaxed);
+      if (c >= _directory.size()) {
+         throw std::length_error("SegmentedSplitVector directory too small");
+      }
+      // Every chunk index is claimed by exactly one thread, so its directory entry is ours
+      _ensure_chunk(c);
+      return c;
+   }
+
+   void _add_partial(size_t c, size_t fill) {
+      std::lock_guard<std::mutex> lock(_partialsLock);
+      _partials.emplace_back(c, fill);
+   }
+};
+
+namespace tools {
+
+/**
+ * @brief Host stream compaction into a SegmentedSplitVector.
+ *
+ * Copies the elements of input for which rule(element) is true to output, keeping their order.
+ * Every host thread counts its range first, so each of them then writes a disjoint output range.
+ */
+template <typename T, class Allocator, int CHUNK_POWER, typename Rule>
+size_t copy_if(const SegmentedSplitVector<T, Allocator, CHUNK_POWER>& input,
+               SegmentedSplitVector<T, Allocator, CHUNK_POWER>& output, Rule rule) {
+   const size_t nThreads = std::max<size_t>(1, std::min(host_threads(), input.size() / 4096));
+   std::vector<size_t> offsets(nThreads + 1, 0);
+   parallel_for(
+       input.size(),
+       [&](size_t begin, size_t end, size_t chunk) {
+          size_t count = 0;
+          for (size_t i = begin; i < end; ++i) {
+             count += rule(input[i]) ? 1 : 0;
+          }
+          offsets[chunk + 1] = count;
+       },
+       1, nThreads);
+   for (size_t t = 0; t < nThreads; ++t) {
+      offsets[t + 1] += offsets[t];
+   }
+   output.resize(offsets[nThreads]);
+   parallel_for(
+       input.size(),
+       [&](size_t begin, size_t end, size_t chunk) {
+          size_t out = offsets[chunk];
+          for (size_t i = begin; i < end; ++i) {
+             if (rule(input[i])) {
+                output[out++] = input[i];
+             }
+          }
+       },
+       1, nThreads);
+   return output.size();
+}
+
+} // namespace tools
+} // namespace split
@@ -5,6 +5,7 @@
  * This file defines the following classes:
  *    --split::split_unified_allocator;
  *    --split::split_host_allocator;
+ *    --split::split_hugepage_allocator;
  *
  * This program is free software; you can redistribute it and/or
  * modify it under the terms of the GNU General Public License
@@ -23,7 +24,13 @@
 #pragma once
 #include "archMacros.h"
 #include "gpu_wrappers.h"
+#include "split_host_tools.h"
 #include <cassert>
+#include <mutex>
+#include <unordered_map>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
 namespace split {
 
 #ifndef SPLIT_CPU_ONLY_MODE
@@ -136,6 +143,7 @@ public:
  * This class provides an allocator for host memory, which can be accessed
  * by the CPU. It allocates and deallocates memory using malloc and free functions,
  * while also providing constructors and destructors for objects.
+ * Large allocations are placed on NUMA nodes according to split::tools::host_numa_policy().
  *
  * @tparam T Type of the allocated objects.
  */
@@ -172,6 +180,7 @@ public:
       if (ret == nullptr) {
          throw std::bad_alloc();
       }
+      tools::numa_place(ret, n * sizeof(value_type));
       return ret;
    }
 
@@ -180,6 +189,7 @@ public:
       if (ret == nullptr) {
          throw std::bad_alloc();
       }
+      tools::numa_place(ret, n);
       return ret;
    }
 
@@ -199,4 +209,174 @@ public:
 
    void destroy(pointer p) { p->~value_type(); }
 };
+
+namespace detail {
+constexpr size_t HUGE_PAGE_2M = 1ul << 21;
+constexpr size_t HUGE_PAGE_1G = 1ul << 30;
+
+// Length of every live huge page mapping, since it depends on which kind of pages backed it
+struct hugepage_registry {
+   std::mutex lock;
+   std::unordered_map<void*, size_t> lengths;
+
+   static hugepage_registry& get() {
+      static hugepage_registry registry;
+      return registry;
+   }
+};
+
+inline size_t round_up(size_t n, size_t alignment) { return (n + alignment - 1) & ~(alignment - 1); }
+
+/**
+ * @brief Maps bytes backed by huge pages.
+ *
+ * Tries hugetlbfs 1 GB pages for allocations of at least 1 GB, then 2 MB hugetlbfs pages and
+ * finally a 2 MB aligned anonymous mapping advised with MADV_HUGEPAGE for transparent huge pages.
+ * Returns nullptr if not even the last one could be mapped.
+ */
+inline void* hugepage_map(size_t bytes) {
+#ifdef __linux__
+   void* ret = MAP_FAILED;
+   size_t length = 0;
+#if defined(MAP_HUGETLB) && defined(MAP_HUGE_SHIFT)
+   if (bytes >= HUGE_PAGE_1G) {
+      length = round_up(bytes, HUGE_PAGE_1G);
+      ret = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (30 << MAP_HUGE_SHIFT), -1, 0);
+   }
+   if (ret == MAP_FAILED) {
+      length = round_up(bytes, HUGE_PAGE_2M);
+      ret = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (21 << MAP_HUGE_SHIFT), -1, 0);
+   }
+#endif
+   if (ret == MAP_FAILED) {
+      // Over-map by one huge page and trim both ends to get a 2 MB aligned region
+      length = round_up(bytes, HUGE_PAGE_2M);
+      void* raw = mmap(nullptr, length + HUGE_PAGE_2M, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (raw == MAP_FAILED) {
+         return nullptr;
+      }
+      const uintptr_t begin = reinterpret_cast<uintptr_t>(raw);
+      const uintptr_t aligned = round_up(begin, HUGE_PAGE_2M);
+      if (aligned != begin) {
+         munmap(raw, aligned - begin);
+      }
+      const size_t tail = HUGE_PAGE_2M - (aligned - begin);
+      if (tail != 0) {
+         munmap(reinterpret_cast<void*>(aligned + length), tail);
+      }
+      ret = reinterpret_cast<void*>(aligned);
+#ifdef MADV_HUGEPAGE
+      madvise(ret, length, MADV_HUGEPAGE);
+#endif
+   }
+   hugepage_registry& registry = hugepage_registry::get();
+   std::lock_guard<std::mutex> guard(registry.lock);
+   registry.lengths[ret] = length;
+   return ret;
+#else
+   (void)bytes;
+   return nullptr;
+#endif
+}
+
+// Unmaps p if it came from hugepage_map and returns whether it did
+inline bool hugepage_unmap(void* p) {
+#ifdef __linux__
+   hugepage_registry& registry = hugepage_registry::get();
+   size_t length;
+   {
+      std::lock_guard<std::mutex> guard(registry.lock);
+      auto it = registry.lengths.find(p);
+      if (it == registry.lengths.end()) {
+         return false;
+      }
+      length = it->second;
+      registry.lengths.erase(it);
+   }
+   munmap(p, length);
+   return true;
+#else
+   (void)p;
+   return false;
+#endif
+}
+} // namespace detail
+
+/**
+ * @brief Custom allocator for host memory backed by huge pages.
+ *
+ * Drop-in replacement of split_host_allocator for large tables that are probed at random, where
+ * 4 KB pages make most probes miss in the TLB. Allocations of at least 2 MB are mapped with
+ * hugetlbfs pages when the system has them reserved and otherwise with 2 MB aligned transparent
+ * huge pages; smaller ones and systems without either fall back to malloc.
+ * Select it through the Allocator parameter of SplitVector or the Meta_Allocator of Hashmap.
+ *
+ * @tparam T Type of the allocated objects.
+ */
+template <class T>
+class split_hugepage_allocator {
+public:
+   typedef T value_type;
+   typedef value_type* pointer;
+   typedef const value_type* const_pointer;
+   typedef value_type& reference;
+   typedef const value_type& const_reference;
+   typedef ptrdiff_t difference_type;
+   typedef size_t size_type;
+   template <class U>
+   struct rebind {
+      typedef split_hugepage_allocator<U> other;
+   };
+
+   /**
+    * @brief Default constructor.
+    */
+   split_hugepage_allocator() throw() {}
+
+   /**
+    * @brief Copy constructor with different type.
+    */
+   template <class U>
+   split_hugepage_allocator(split_hugepage_allocator<U> const&) throw() {}
+   pointer address(reference x) const { return &x; }
+   const_pointer address(const_reference x) const { return &x; }
+
+   pointer allocate(size_type n, const void* /*hint*/ = 0) {
+      return reinterpret_cast<pointer>(allocate_raw(n * sizeof(value_type)));
+   }
+
+   static void* allocate_raw(size_type n, const void* /*hint*/ = 0) {
+      void* ret = n >= detail::HUGE_PAGE_2M ? detail::hugepage_map(n) : nullptr;
+      if (ret == nullptr) {
+         ret = malloc(n);
+      }
+      if (ret == nullptr) {
+         throw std::bad_alloc();
+      }
+      tools::numa_place(ret, n);
+      return ret;
+   }
+
+   void deallocate(pointer p, size_type n) { deallocate(static_cast<void*>(p), n); }
+
+   static void deallocate(void* p, size_type) {
+      if (p != nullptr && !detail::hugepage_unmap(p)) {
+         free(p);
+      }
+   }
+
+   size_type max_size() const throw() {
+      size_type max = static_cast<size_type>(-1) / sizeof(value_type);
+      return (max > 0 ? max : 1);
+   }
+
+   template <typename U, typename... Args>
+   void construct(U* p, Args&&... args) {
+      ::new (p) U(std::forward<Args>(args)...);
+   }
+
+   void destroy(pointer p) { p->~value_type(); }
+};
 } // namespace split
@@ -0,0 +1,141 @@
+/* File:    split_growth.h
+ * Authors: Kostis Papadakis (2023)
+ * Description: Growth policies and a process wide memory budget
+ *              used when SplitVector reserves more space.
+ *
+ * This file defines the following classes or functions:
+ *    --split::GrowthPolicy
+ *    --split::memory_budget
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ * */
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <limits>
+#include <new>
+
+namespace split {
+
+/**
+ * @brief Decides how much capacity a SplitVector allocates when it has to grow.
+ *
+ * The policy is applied to the current capacity, never to the requested size, and the result is
+ * never smaller than the request:
+ *    --geometric(f)       capacity*f, the default with f=2
+ *    --fixed_increment(n) capacity+n elements
+ *    --exact_fit()        the request rounded up to whole pages
+ */
+class GrowthPolicy {
+public:
+   enum class Kind { geometric, fixed_increment, exact_fit };
+
+   static constexpr size_t PAGE_BYTES = 4096;
+
+   static constexpr GrowthPolicy geometric(double factor = 2.0) {
+      return GrowthPolicy(Kind::geometric, factor < 1.0 ? 1.0 : factor, 0);
+   }
+   static constexpr GrowthPolicy fixed_increment(size_t elements) {
+      return GrowthPolicy(Kind::fixed_increment, 1.0, elements);
+   }
+   static constexpr GrowthPolicy exact_fit() { return GrowthPolicy(Kind::exact_fit, 1.0, 0); }
+
+   constexpr GrowthPolicy() : GrowthPolicy(Kind::geometric, 2.0, 0) {}
+
+   constexpr Kind kind() const noexcept { return _kind; }
+   constexpr double factor() const noexcept { return _factor; }
+   constexpr size_t increment() const noexcept { return _increment; }
+
+   /**
+    * @brief Capacity, in elements of elementBytes, to allocate for a request that exceeds capacity.
+    */
+   size_t grow(size_t capacity, size_t requested, size_t elementBytes) const noexcept {
+      const size_t maxElements = std::numeric_limits<size_t>::max() / elementBytes;
+      size_t target = requested;
+      switch (_kind) {
+      case Kind::geometric: {
+         const double scaled = static_cast<double>(capacity) * _factor;
+         target = scaled >= static_cast<double>(maxElements) ? maxElements : static_cast<size_t>(scaled);
+         break;
+      }
+      case Kind::fixed_increment:
+         target = _increment > maxElements - capacity ? maxElements : capacity + _increment;
+         break;
+      case Kind::exact_fit:
+         if (requested <= (std::numeric_limits<size_t>::max() - PAGE_BYTES) / elementBytes) {
+            const size_t bytes = (requested * elementBytes + PAGE_BYTES - 1) / PAGE_BYTES * PAGE_BYTES;
+            target = bytes / elementBytes;
+         }
+         break;
+      }
+      return std::max(target, requested);
+   }
+
+private:
+   constexpr GrowthPolicy(Kind kind, double factor, size_t increment)
+       : _kind(kind), _factor(factor), _increment(increment) {}
+
+   Kind _kind;
+   double _factor;
+   size_t _increment;
+};
+
+/**
+ * @brief Process wide limit on the bytes held by the elements of all SplitVectors.
+ *
+ * Every SplitVector data allocation is charged here. reserve() first shrinks its growth to fit
+ * the budget and throws std::bad_alloc if even the requested size does not fit. The old buffer is
+ * still alive while the elements are copied over, so it counts against the budget until then.
+ * The budget is unlimited by default; constructors and copies are charged but never refused.
+ */
+namespace memory_budget {
+
+inline std::atomic<size_t>& _limit() {
+   static std::atomic<size_t> limit{std::numeric_limits<size_t>::max()};
+   return limit;
+}
+
+inline std::atomic<size_t>& _used() {
+   static std::atomic<size_t> used{0};
+   return used;
+}
+
+inline void set(size_t bytes) noexcept { _limit().store(bytes, std::memory_order_relaxed); }
+inline void unlimited() noexcept { set(std::numeric_limits<size_t>::max()); }
+inline size_t limit() noexcept { return _limit().load(std::memory_order_relaxed); }
+inline size_t in_use() noexcept { return _used().load(std::memory_order_relaxed); }
+
+inline void charge(size_t bytes) noexcept { _used().fetch_add(bytes, std::memory_order_relaxed); }
+inline void release(size_t bytes) noexcept { _used().fetch_sub(bytes, std::memory_order_relaxed); }
+
+/**
+ * @brief Clamps a growth target so that allocating it keeps in_use() within the limit.
+ *
+ * @return The largest capacity in [requested,target] that fits.
+ * @throws std::bad_alloc If requested elements do not fit.
+ */
+inline size_t fit(size_t requested, size_t target, size_t elementBytes) {
+   const size_t cap = limit();
+   const size_t used = in_use();
+   const size_t room = cap > used ? (cap - used) / elementBytes : 0;
+   if (requested > room) {
+      throw std::bad_alloc();
+   }
+   return std::min(target, room);
+}
+
+} // namespace memory_budget
+} // namespace split
@@ -0,0 +1,425 @@
+/* File:    split_host_stream.h
+ * Authors: Kostis Papadakis (2023)
+ * Description: Emulation of GPU streams and events on host threads
+ *              for the CPU only mode of SplitVector and Hashinator.
+ *
+ * This file defines the following classes or functions:
+ *    --split::host_stream
+ *    --split::host_event
+ *    --split::host_launch
+ *    --split::host_stream_create and the other stream and event functions
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ * */
+#pragma once
+#include "split_host_tools.h"
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace split {
+
+class host_stream;
+
+// Completion of the work recorded by an event, see host_event
+struct _host_marker {
+   std::mutex lock;
+   std::condition_variable cv;
+   bool done = false;
+   std::vector<host_stream*> waiters; // Streams parked until done
+};
+
+/**
+ * @brief Workers shared by all host streams.
+ *
+ * A stream with pending tasks is queued here and taken by one worker, which runs its next task
+ * and queues the stream again at the back if more are pending. A stream is therefore never run
+ * by two workers at once, so its tasks execute in order, and streams take turns when there are
+ * more busy streams than workers. Tasks still use parallel_for internally.
+ * The number of workers is host_threads(), or SPLIT_HOST_STREAM_THREADS if set.
+ */
+class _host_stream_pool {
+public:
+   static _host_stream_pool& instance() {
+      static _host_stream_pool pool;
+      return pool;
+   }
+
+   void post(host_stream* s) {
+      {
+         std::lock_guard<std::mutex> guard(_lock);
+         _ready.push_back(s);
+      }
+      _cv.notify_one();
+   }
+
+   ~_host_stream_pool() {
+      {
+         std::lock_guard<std::mutex> guard(_lock);
+         _stop = true;
+      }
+      _cv.notify_all();
+      for (auto& w : _workers) {
+         w.join();
+      }
+   }
+
+private:
+   _host_stream_pool() {
+      size_t nWorkers = tools::host_threads();
+      if (const char* env = std::getenv("SPLIT_HOST_STREAM_THREADS")) {
+         const long requested = std::atol(env);
+         if (requested > 0) {
+            nWorkers = static_cast<size_t>(requested);
+         }
+      }
+      _workers.reserve(nWorkers);
+      for (size_t i = 0; i < nWorkers; ++i) {
+         _workers.emplace_back([this]() { _work(); });
+      }
+   }
+
+   inline void _work();
+
+   std::mutex _lock;
+   std::condition_variable _cv;
+   std::deque<host_stream*> _ready;
+   bool _stop = false;
+   std::vector<std::thread> _workers;
+};
+
+/**
+ * @brief Ordered queue of host tasks, the CPU counterpart of a GPU stream.
+ *
+ * Tasks run asynchronously to the calling thread but in submission order, and tasks of
+ * different streams run concurrently. As on a GPU, the data a task uses must stay alive and
+ * untouched by the host until the stream is synchronized or an event recorded after the task
+ * completed. The first exception thrown by a task is rethrown by synchronize(); later tasks
+ * still run. A task must not wait for another stream, since that stream may need its worker.
+ */
+class host_stream {
+public:
+   host_stream() = default;
+   host_stream(const host_stream&) = delete;
+   host_stream& operator=(const host_stream&) = delete;
+
+   // Waits for all tasks, an exception pending in the stream is dropped
+   ~host_stream() { _wait_idle(); }
+
+   // Queues fn() behind the tasks already in the stream
+   template <typename Fn>
+   void enqueue(Fn&& fn) {
+      _push(_task{std::function<void()>(std::forward<Fn>(fn)), nullptr});
+   }
+
+   // Blocks until all queued tasks completed and rethrows the first exception thrown by them
+   void synchronize() {
+      _wait_idle();
+      std::exception_ptr error;
+      {
+         std::lock_guard<std::mutex> guard(_lock);
+         std::swap(error, _error);
+      }
+      if (error) {
+         std::rethrow_exception(error);
+      }
+   }
+
+   // True if all queued tasks completed
+   bool query() {
+      std::lock_guard<std::mutex> guard(_lock);
+      return _tasks.empty();
+   }
+
+private:
+   friend class _host_stream_pool;
+   friend class host_event;
+
+   // A task with a marker is a wait: the stream stops there until the marker is done
+   struct _task {
+      std::function<void()> fn;
+      std::shared_ptr<_host_marker> after;
+   };
+
+   void _push(_task&& task) {
+      bool idle;
+      {
+         std::lock_guard<std::mutex> guard(_lock);
+         idle = _tasks.empty();
+         _tasks.push_back(std::move(task));
+      }
+      if (idle) {
+         _host_stream_pool::instance().post(this);
+      }
+   }
+
+   void _wait_idle() {
+      std::unique_lock<std::mutex> guard(_lock);
+      _idle.wait(guard, [this]() { return _tasks.empty(); });
+   }
+
+   // Runs the next task on a pool worker, returns true if the stream has more to run
+   bool _step() {
+      _task* task;
+      {
+         std::lock_guard<std::mutex> guard(_lock);
+         task = &_tasks.front();
+      }
+      // Only this worker pops or runs the front task, so it stays valid without the lock
+      if (task->after) {
+         std::lock_guard<std::mutex> guard(task->after->lock);
+         if (!task->after->done) {
+            // Parked, the event requeues the stream once it completes
+            task->after->waiters.push_back(this);
+            return false;
+         }
+      } else {
+         try {
+            task->fn();
+         } catch (...) {
+            std::lock_guard<std::mutex> guard(_lock);
+            if (!_error) {
+               _error = std::current_exception();
+            }
+         }
+      }
+      std::lock_guard<std::mutex> guard(_lock);
+      _tasks.pop_front();
+      if (_tasks.empty()) {
+         _idle.notify_all();
+         return false;
+      }
+      return true;
+   }
+
+   std::mutex _lock;
+   std::condition_variable _idle;
+   std::deque<_task> _tasks; // The front task is running or waiting
+   std::exception_ptr _error;
+};
+
+inline void _host_stream_pool::_work() {
+   for (;;) {
+      host_stream* s;
+      {
+         std::unique_lock<std::mutex> guard(_lock);
+         _cv.wait(guard, [this]() { return _stop || !_ready.empty(); });
+         if (_ready.empty()) {
+            return;
+         }
+         s = _ready.front();
+         _ready.pop_front();
+      }
+      if (s->_step()) {
+         post(s);
+      }
+   }
+}
+
+/**
+ * @brief Marks a point in a stream, the CPU counterpart of a GPU event.
+ *
+ * record() captures the tasks queued in a stream so far, the event completes once they did.
+ * Recording again replaces the captured work, as for GPU events. An event never recorded is
+ * complete.
+ */
+class host_event {
+public:
+   host_event() = default;
+   host_event(const host_event&) = delete;
+   host_event& operator=(const host_event&) = delete;
+
+   // Captures the work queued in s, a null stream has none
+   void record(host_stream* s) {
+      auto marker = std::make_shared<_host_marker>();
+      {
+         std::lock_guard<std::mutex> guard(_lock);
+         _marker = marker;
+      }
+      if (s == nullptr) {
+         _complete(*marker);
+         return;
+      }
+      s->enqueue([marker]() { _complete(*marker); });
+   }
+
+   // Makes the tasks queued in s from now on wait for the captured work
+   void wait_in(host_stream* s) {
+      std::shared_ptr<_host_marker> marker = _current();
+      if (s == nullptr) {
+         synchronize();
+         return;
+      }
+      if (marker) {
+         s->_push(host_stream::_task{nullptr, std::move(marker)});
+      }
+   }
+
+   void synchronize() {
+      std::shared_ptr<_host_marker> marker = _current();
+      if (marker) {
+         std::unique_lock<std::mutex> guard(marker->lock);
+         marker->cv.wait(guard, [&]() { return marker->done; });
+      }
+   }
+
+   bool query() {
+      std::shared_ptr<_host_marker> marker = _current();
+      if (!marker) {
+         return true;
+      }
+      std::lock_guard<std::mutex> guard(marker->lock);
+      return marker->done;
+   }
+
+private:
+   std::shared_ptr<_host_marker> _current() {
+      std::lock_guard<std::mutex> guard(_lock);
+      return _marker;
+   }
+
+   static void _complete(_host_marker& marker) {
+      std::vector<host_stream*> waiters;
+      {
+         std::lock_guard<std::mutex> guard(marker.lock);
+         marker.done = true;
+         std::swap(waiters, marker.waiters);
+      }
+      marker.cv.notify_all();
+      for (host_stream* s : waiters) {
+         _host_stream_pool::instance().post(s);
+      }
+   }
+
+   std::mutex _lock;
+   std::shared_ptr<_host_marker> _marker;
+};
+
+/**
+ * @brief Runs fn() on stream s, or right away on the calling thread if s is null.
+ *
+ * The null stream is the blocking default of the CPU only mode, so code written against
+ * streams behaves as before when no stream is passed.
+ */
+template <typename Fn>
+void host_launch(host_stream* s, Fn&& fn) {
+   if (s == nullptr) {
+      fn();
+      return;
+   }
+   s->enqueue(std::forward<Fn>(fn));
+}
+
+/*
+ * Free functions with the signatures of the GPU runtime ones, behind the split_gpu* names below,
+ * so that stream handling code compiles unchanged in CPU only mode.
+ * */
+enum class host_error { success, not_ready };
+
+inline host_error host_stream_create(host_stream** s) {
+   *s = new host_stream();
+   return host_error::success;
+}
+
+inline host_error host_stream_destroy(host_stream* s) {
+   delete s;
+   return host_error::success;
+}
+
+inline host_error host_stream_synchronize(host_stream* s) {
+   if (s != nullptr) {
+      s->synchronize();
+   }
+   return host_error::success;
+}
+
+inline host_error host_stream_query(host_stream* s) {
+   return (s == nullptr || s->query()) ? host_error::success : host_error::not_ready;
+}
+
+inline host_error host_stream_wait_event(host_stream* s, host_event* e, unsigned int flags = 0) {
+   (void)flags;
+   e->wait_in(s);
+   return host_error::success;
+}
+
+inline host_error host_event_create(host_event** e) {
+   *e = new host_event();
+   return host_error::success;
+}
+
+inline host_error host_event_destroy(host_event* e) {
+   delete e;
+   return host_error::success;
+}
+
+inline host_error host_event_record(host_event* e, host_stream* s = nullptr) {
+   e->record(s);
+   return host_error::success;
+}
+
+inline host_error host_event_synchronize(host_event* e) {
+   e->synchronize();
+   return host_error::success;
+}
+
+inline host_error host_event_query(host_event* e) {
+   return e->query() ? host_error::success : host_error::not_ready;
+}
+
+inline const char* host_error_string(host_error err) {
+   return err == host_error::success ? "success" : "stream or event not ready";
+}
+
+inline void host_check_error(host_error err, const char* file, int line) {
+   if (err != host_error::success) {
+      std::fprintf(stderr, "\n\n%s in %s at line %d\n", host_error_string(err), file, line);
+      abort();
+   }
+}
+
+} // namespace split
+
+// Types rather than macros, so that split_gpuStream_t s1, s2; declares two handles
+typedef split::host_stream* split_gpuStream_t;
+typedef split::host_event* split_gpuEvent_t;
+typedef split::host_error split_gpuError_t;
+#define split_gpuSuccess split::host_error::success
+#define split_gpuErrorNotReady split::host_error::not_ready
+#define split_gpuGetErrorString split::host_error_string
+
+#define split_gpuStreamCreate split::host_stream_create
+#define split_gpuStreamDestroy split::host_stream_destroy
+#define split_gpuStreamSynchronize split::host_stream_synchronize
+#define split_gpuStreamQuery split::host_stream_query
+#define split_gpuStreamWaitEvent split::host_stream_wait_event
+
+#define split_gpuEventCreate split::host_event_create
+#define split_gpuEventDestroy split::host_event_destroy
+#define split_gpuEventRecord split::host_event_record
+#define split_gpuEventSynchronize split::host_event_synchronize
+#define split_gpuEventQuery split::host_event_query
+
+#ifndef SPLIT_CHECK_ERR
+#define SPLIT_CHECK_ERR(err) (split::host_check_error(err, __FILE__, __LINE__))
+#endif
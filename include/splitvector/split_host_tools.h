@@ -0,0 +1,296 @@
+/* File:    split_host_tools.h
+ * Authors: Kostis Papadakis (2023)
+ * Description: Set of host threading tools used by SplitVector and Hashinator
+ *
+ * This file defines the following classes or functions:
+ *    --split::tools::host_threads
+ *    --split::tools::parallel_for
+ *    --split::tools::numa_policy
+ *    --split::tools::numa_nodes
+ *    --split::tools::numa_place
+ *    --split::tools::numa_bind_node
+ *    --split::tools::pin_thread_to_node
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ * */
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <thread>
+#include <vector>
+#ifdef __linux__
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace split {
+namespace tools {
+
+/**
+ * @brief Number of host threads used by the parallel host paths.
+ *
+ * Defaults to the hardware concurrency and can be overridden with the
+ * SPLIT_HOST_THREADS environment variable.
+ */
+inline size_t host_threads() noexcept {
+   static const size_t nThreads = []() -> size_t {
+      if (const char* env = std::getenv("SPLIT_HOST_THREADS")) {
+         const long requested = std::atol(env);
+         if (requested > 0) {
+            return static_cast<size_t>(requested);
+         }
+      }
+      return std::max(1u, std::thread::hardware_concurrency());
+   }();
+   return nThreads;
+}
+
+/**
+ * @brief Splits [0,n) into contiguous chunks and runs them on host threads.
+ *
+ * fn is called as fn(begin, end, chunk) once per chunk, with chunk in [0, nChunks).
+ * Ranges smaller than minChunk elements per thread use fewer threads, down to a plain call
+ * on the calling thread. The calling thread always processes the first chunk.
+ * The first exception thrown by any chunk is rethrown after all threads joined.
+ *
+ * @param n Number of elements.
+ * @param fn Callable with signature void(size_t begin, size_t end, size_t chunk).
+ * @param minChunk Minimum number of elements per chunk.
+ * @param maxThreads Upper bound on the number of chunks, 0 means host_threads().
+ * @return The number of chunks used.
+ */
+template <typename Fn>
+size_t parallel_for(size_t n, Fn&& fn, size_t minChunk = 1, size_t maxThreads = 0) {
+   if (maxThreads == 0) {
+      maxThreads = host_threads();
+   }
+   minChunk = std::max<size_t>(minChunk, 1);
+   const size_t nChunks = std::max<size_t>(1, std::min(maxThreads, n / minChunk));
+   if (nChunks == 1) {
+      fn(size_t(0), n, size_t(0));
+      return 1;
+   }
+
+   std::vector<std::exception_ptr> errors(nChunks, nullptr);
+   auto runChunk = [&](size_t chunk) {
+      const size_t begin = (n * chunk) / nChunks;
+      const size_t end = (n * (chunk + 1)) / nChunks;
+      try {
+         fn(begin, end, chunk);
+      } catch (...) {
+         errors[chunk] = std::current_exception();
+      }
+   };
+
+   std::vector<std::thread> workers;
+   workers.reserve(nChunks - 1);
+   for (size_t chunk = 1; chunk < nChunks; ++chunk) {
+      workers.emplace_back(runChunk, chunk);
+   }
+   runChunk(0);
+   for (auto& w : workers) {
+      w.join();
+   }
+   for (auto& e : errors) {
+      if (e) {
+         std::rethrow_exception(e);
+      }
+   }
+   return nChunks;
+}
+
+/**
+ * @brief Placement of large host allocations on NUMA nodes.
+ *
+ * none:       pages land on the node of the thread touching them first (OS default).
+ * interleave: pages are spread round robin over all nodes.
+ * blocked:    the allocation is split in as many contiguous slices as there are nodes and slice k
+ *             prefers node k. For hashmap buckets slice k holds one range of hash prefixes, so
+ *             the partitioned insert can route every partition to threads on its node.
+ */
+enum class numa_policy { none, interleave, blocked };
+
+// Allocations smaller than this are never placed explicitly
+constexpr size_t NUMA_MIN_BYTES = 1ul << 21;
+
+inline std::atomic<numa_policy>& _numa_policy_state() noexcept {
+   static std::atomic<numa_policy> policy{[]() {
+      if (const char* env = std::getenv("SPLIT_NUMA_POLICY")) {
+         if (std::strcmp(env, "interleave") == 0) {
+            return numa_policy::interleave;
+         }
+         if (std::strcmp(env, "blocked") == 0) {
+            return numa_policy::blocked;
+         }
+      }
+      return numa_policy::none;
+   }()};
+   return policy;
+}
+
+/**
+ * @brief Current NUMA policy of split_host_allocator.
+ *
+ * Defaults to none and can be set with the SPLIT_NUMA_POLICY environment variable
+ * (interleave or blocked) or with set_host_numa_policy.
+ */
+inline numa_policy host_numa_policy() noexcept { return _numa_policy_state().load(std::memory_order_relaxed); }
+
+/**
+ * @brief Sets the NUMA policy applied to subsequent large host allocations.
+ */
+inline void set_host_numa_policy(numa_policy policy) noexcept {
+   _numa_policy_state().store(policy, std::memory_order_relaxed);
+}
+
+// Parses a sysfs list such as "0-3,8,10-11"
+inline std::vector<size_t> _read_sysfs_list(const char* path) {
+   std::vector<size_t> ids;
+   FILE* f = std::fopen(path, "r");
+   if (f == nullptr) {
+      return ids;
+   }
+   unsigned long first, last;
+   while (std::fscanf(f, "%lu", &first) == 1) {
+      last = first;
+      int c = std::fgetc(f);
+      if (c == '-') {
+         if (std::fscanf(f, "%lu", &last) != 1) {
+            break;
+         }
+         c = std::fgetc(f);
+      }
+      for (unsigned long id = first; id <= last; ++id) {
+         ids.push_back(id);
+      }
+      if (c != ',') {
+         break;
+      }
+   }
+   std::fclose(f);
+   return ids;
+}
+
+/**
+ * @brief Number of NUMA nodes of the host, 1 where this cannot be queried.
+ */
+inline size_t numa_nodes() noexcept {
+   static const size_t nNodes = []() -> size_t {
+      const std::vector<size_t> nodes = _read_sysfs_list("/sys/devices/system/node/online");
+      // Only dense node ids up to the width of one node mask are supported
+      if (nodes.empty() || nodes.back() + 1 != nodes.size() || nodes.size() > 64) {
+         return 1;
+      }
+      return nodes.size();
+   }();
+   return nNodes;
+}
+
+// Applies a memory policy to the pages fully inside [p, p + bytes). Returns false if the
+// kernel does not support it, in which case the pages keep the default placement.
+inline bool _numa_mbind(void* p, size_t bytes, int mode, uint64_t nodemask) noexcept {
+#if defined(__linux__) && defined(SYS_mbind)
+   constexpr unsigned MPOL_MF_MOVE = 1u << 1;
+   const uintptr_t page = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+   const uintptr_t begin = (reinterpret_cast<uintptr_t>(p) + page - 1) & ~(page - 1);
+   const uintptr_t end = (reinterpret_cast<uintptr_t>(p) + bytes) & ~(page - 1);
+   if (end <= begin) {
+      return false;
+   }
+   unsigned long mask = static_cast<unsigned long>(nodemask);
+   return syscall(SYS_mbind, begin, end - begin, mode, &mask, 8 * sizeof(mask) + 1, MPOL_MF_MOVE) == 0;
+#else
+   (void)p;
+   (void)bytes;
+   (void)mode;
+   (void)nodemask;
+   return false;
+#endif
+}
+
+/**
+ * @brief Places a fresh host allocation according to host_numa_policy().
+ *
+ * Does nothing for small allocations, on single node hosts or where the kernel refuses,
+ * so it is always safe to call.
+ */
+inline void numa_place(void* p, size_t bytes) noexcept {
+   constexpr int MPOL_PREFERRED = 1;
+   constexpr int MPOL_INTERLEAVE = 3;
+   const numa_policy policy = host_numa_policy();
+   const size_t nNodes = numa_nodes();
+   if (policy == numa_policy::none || nNodes < 2 || bytes < NUMA_MIN_BYTES) {
+      return;
+   }
+   if (policy == numa_policy::interleave) {
+      const uint64_t all = nNodes == 64 ? ~uint64_t(0) : (uint64_t(1) << nNodes) - 1;
+      _numa_mbind(p, bytes, MPOL_INTERLEAVE, all);
+      return;
+   }
+   char* base = static_cast<char*>(p);
+   for (size_t node = 0; node < nNodes; ++node) {
+      const size_t begin = (bytes * node) / nNodes;
+      const size_t end = (bytes * (node + 1)) / nNodes;
+      _numa_mbind(base + begin, end - begin, MPOL_PREFERRED, uint64_t(1) << node);
+   }
+}
+
+/**
+ * @brief Binds the pages of [p, p + bytes) to node, migrating the ones already touched.
+ * @return false if the pages could not be bound.
+ */
+inline bool numa_bind_node(void* p, size_t bytes, size_t node) noexcept {
+   constexpr int MPOL_BIND = 2;
+   if (node >= numa_nodes()) {
+      return false;
+   }
+   return _numa_mbind(p, bytes, MPOL_BIND, uint64_t(1) << node);
+}
+
+/**
+ * @brief Restricts the calling thread to the cpus of node.
+ * @return false if the affinity could not be changed.
+ */
+inline bool pin_thread_to_node(size_t node) noexcept {
+#ifdef __linux__
+   char path[64];
+   std::snprintf(path, sizeof(path), "/sys/devices/system/node/node%zu/cpulist", node);
+   const std::vector<size_t> cpus = _read_sysfs_list(path);
+   if (cpus.empty()) {
+      return false;
+   }
+   cpu_set_t set;
+   CPU_ZERO(&set);
+   for (size_t cpu : cpus) {
+      if (cpu < CPU_SETSIZE) {
+         CPU_SET(cpu, &set);
+      }
+   }
+   return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+   (void)node;
+   return false;
+#endif
+}
+
+} // namespace tools
+} // namespace split
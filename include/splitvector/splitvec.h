@@ -23,8 +23,12 @@
  * */
 #pragma once
 #include "split_allocators.h"
+#include "split_growth.h"
+#include "split_host_tools.h"
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cstring>
 #include <iostream>
 #include <memory>
 #include <optional>
@@ -43,6 +47,7 @@
 template <typename T>
 using DefaultAllocator = split::split_unified_allocator<T>;
 #else
+#include "split_host_stream.h"
 #define HOSTONLY
 #define DEVICEONLY
 #define HOSTDEVICE
@@ -85,9 +90,15 @@ class SplitVector {
 
 private:
    T* _data = nullptr;           // actual pointer to our data
+#ifdef SPLIT_CPU_ONLY_MODE
+   // Host only vectors need no unified memory metadata, so size and capacity live in the object
+   size_t _size = 0;             // number of elements in vector.
+   size_t _capacity = 0;         // number of allocated elements
+#else
    size_t* _size;                // number of elements in vector.
    size_t* _capacity;            // number of allocated elements
-   size_t _alloc_multiplier = 2; // host variable; multiplier for  when reserving more space
+#endif
+   GrowthPolicy _growth;         // host variable; how much capacity reserve adds when growing
    Allocator _allocator;         // Allocator used to allocate and deallocate memory;
    Residency _location;          // Flags that describes the current residency of our data
    SplitVector* d_vec = nullptr; // device copy pointer
@@ -98,6 +109,64 @@ private:
     */
    inline void _check_ptr(void* ptr) { assert(ptr); }
 
+   // Bulk copies of trivially copyable elements above this many bytes are split over host threads
+   static constexpr size_t PARALLEL_COPY_BYTES = size_t(1) << 22;
+
+   /**
+    * @brief Copies n elements to non overlapping, already constructed storage on the host.
+    *
+    * Trivially copyable types are copied with memcpy, by several threads for large ranges.
+    */
+   HOSTONLY static void _copy_elements(T* dst, const T* src, size_t n) {
+      if constexpr (std::is_trivially_copyable<T>::value) {
+         if (n * sizeof(T) < PARALLEL_COPY_BYTES) {
+            if (n > 0) {
+               std::memcpy(static_cast<void*>(dst), static_cast<const void*>(src), n * sizeof(T));
+            }
+            return;
+         }
+         split::tools::parallel_for(
+             n,
+             [dst, src](size_t begin, size_t end, size_t) {
+                std::memcpy(static_cast<void*>(dst + begin), static_cast<const void*>(src + begin),
+                            (end - begin) * sizeof(T));
+             },
+             PARALLEL_COPY_BYTES / sizeof(T));
+      } else {
+         std::copy(src, src + n, dst);
+      }
+   }
+
+   /**
+    * @brief Moves n elements from src to dst on the host, where the two ranges may overlap.
+    */
+   HOSTONLY static void _move_elements(T* dst, T* src, size_t n) {
+      if constexpr (std::is_trivially_copyable<T>::value) {
+         if (n > 0) {
+            std::memmove(static_cast<void*>(dst), static_cast<const void*>(src), n * sizeof(T));
+         }
+      } else if (dst < src) {
+         std::move(src, src + n, dst);
+      } else {
+         std::move_backward(src, src + n, dst + n);
+      }
+   }
+
+   /**
+    * @brief Access to the size and capacity wherever they are stored.
+    */
+#ifdef SPLIT_CPU_ONLY_MODE
+   HOSTDEVICE size_t& _size_ref() noexcept { return _size; }
+   HOSTDEVICE const size_t& _size_ref() const noexcept { return _size; }
+   HOSTDEVICE size_t& _capacity_ref() noexcept { return _capacity; }
+   HOSTDEVICE const size_t& _capacity_ref() const noexcept { return _capacity; }
+#else
+   HOSTDEVICE size_t& _size_ref() noexcept { return *_size; }
+   HOSTDEVICE const size_t& _size_ref() const noexcept { return *_size; }
+   HOSTDEVICE size_t& _capacity_ref() noexcept { return *_capacity; }
+   HOSTDEVICE const size_t& _capacity_ref() const noexcept { return *_capacity; }
+#endif
+
    /**
     * @brief Internal range check used in the .at() method.
     *
@@ -115,17 +184,28 @@ private:
     * @brief Allocates memory for the vector on the host.
     *
     * @param size Number of elements to allocate.
+    * @param construct False when the caller overwrites all elements right away, which lets
+    *                  trivially copyable elements skip their initialization.
     * @throws std::bad_alloc If memory allocation fails.
     */
-   HOSTONLY void _allocate(size_t size) {
+   HOSTONLY void _allocate(size_t size, bool construct = true) {
+#ifdef SPLIT_CPU_ONLY_MODE
+      _size = size;
+      _capacity = size;
+#else
       _size = _allocate_and_construct(size);
       _capacity = _allocate_and_construct(size);
       _check_ptr(_size);
       _check_ptr(_capacity);
+#endif
       if (size == 0) {
          return;
       }
-      _data = _allocate_and_construct(size, T());
+      if constexpr (std::is_trivially_copyable<T>::value) {
+         _data = construct ? _allocate_and_construct(size, T()) : _allocate_raw(size);
+      } else {
+         _data = _allocate_and_construct(size, T());
+      }
       _check_ptr(_data);
       if (_data == nullptr) {
          _deallocate();
@@ -141,8 +221,10 @@ private:
          _deallocate_and_destroy(capacity(), _data);
          _data = nullptr;
       }
+#ifndef SPLIT_CPU_ONLY_MODE
       _deallocate_and_destroy(_capacity);
       _deallocate_and_destroy(_size);
+#endif
    }
 
    /**
@@ -153,13 +235,42 @@ private:
     * @return Pointer to the allocated and constructed memory.
     */
    HOSTONLY T* _allocate_and_construct(size_t n, const T& val) {
+      T* _ptr = _allocate_raw(n);
+      if constexpr (std::is_trivially_copyable<T>::value) {
+         if (_ptr != nullptr) {
+            std::uninitialized_fill_n(_ptr, n, val);
+         }
+      } else {
+         for (size_t i = 0; i < n; i++) {
+            _allocator.construct(&_ptr[i], val);
+         }
+      }
+      return _ptr;
+   }
+
+   /**
+    * @brief Allocates uninitialized memory for n elements and charges it to the memory budget.
+    */
+   HOSTONLY T* _allocate_raw(size_t n) {
       T* _ptr = _allocator.allocate(n);
-      for (size_t i = 0; i < n; i++) {
-         _allocator.construct(&_ptr[i], val);
+      if (_ptr != nullptr) {
+         memory_budget::charge(n * sizeof(T));
       }
       return _ptr;
    }
 
+   /**
+    * @brief Capacity that reserve() allocates for requested elements under the growth policy
+    * and the memory budget.
+    *
+    * @param eco Skips the growth policy and allocates exactly the requested space.
+    * @throws std::bad_alloc If the requested space does not fit in the memory budget.
+    */
+   HOSTONLY size_t _grown_capacity(size_t requested, bool eco) const {
+      const size_t target = eco ? requested : _growth.grow(capacity(), requested, sizeof(T));
+      return memory_budget::fit(requested, target, sizeof(T));
+   }
+
    /**
     * @brief Allocates memory and constructs metadata on the host.
     *
@@ -180,8 +291,13 @@ private:
     * @param _ptr Pointer to the memory to be deallocated and destroyed.
     */
    HOSTONLY void _deallocate_and_destroy(size_t n, T* _ptr) {
-      for (size_t i = 0; i < n; i++) {
-         _allocator.destroy(&_ptr[i]);
+      if constexpr (!std::is_trivially_destructible<T>::value) {
+         for (size_t i = 0; i < n; i++) {
+            _allocator.destroy(&_ptr[i]);
+         }
+      }
+      if (_ptr != nullptr) {
+         memory_budget::release(n * sizeof(T));
       }
       _allocator.deallocate(_ptr, n);
    }
@@ -243,23 +359,17 @@ public:
     * @param other The SplitVector to be copied.
     */
 #ifdef SPLIT_CPU_ONLY_MODE
-   HOSTONLY explicit SplitVector(const SplitVector<T, Allocator>& other) {
+   HOSTONLY explicit SplitVector(const SplitVector<T, Allocator>& other) : _growth(other._growth) {
       const size_t size_to_allocate = other.size();
-      this->_allocate(size_to_allocate);
-      for (size_t i = 0; i < size_to_allocate; i++) {
-         _data[i] = other._data[i];
-      }
+      this->_allocate(size_to_allocate, false);
+      _copy_elements(_data, other._data, size_to_allocate);
    }
 #else
 
-   HOSTONLY explicit SplitVector(const SplitVector<T, Allocator>& other) {
+   HOSTONLY explicit SplitVector(const SplitVector<T, Allocator>& other) : _growth(other._growth) {
       const size_t size_to_allocate = other.size();
-      auto copySafe = [&]() -> void {
-         for (size_t i = 0; i < size_to_allocate; i++) {
-            _data[i] = other._data[i];
-         }
-      };
-      this->_allocate(size_to_allocate);
+      auto copySafe = [&]() -> void { _copy_elements(_data, other._data, size_to_allocate); };
+      this->_allocate(size_to_allocate, false);
       if constexpr (std::is_trivially_copyable<T>::value) {
          if (other._location == Residency::device) {
             _location = Residency::device;
@@ -280,12 +390,17 @@ public:
     * @param other The SplitVector to be moved from.
     */
    HOSTONLY SplitVector(SplitVector<T, Allocator>&& other) noexcept {
+#ifndef SPLIT_CPU_ONLY_MODE
+      _size = _allocate_and_construct(0);
+      _capacity = _allocate_and_construct(0);
+#endif
       _data = other._data;
-      *_size = other.size();
-      *_capacity = other.capacity();
-      *(other._capacity) = 0;
-      *(other._size) = 0;
+      _size_ref() = other.size();
+      _capacity_ref() = other.capacity();
+      other._capacity_ref() = 0;
+      other._size_ref() = 0;
       other._data = nullptr;
+      _growth = other._growth;
       _location = other._location;
       d_vec = nullptr;
    }
@@ -296,10 +411,8 @@ public:
     * @param init_list The initializer list to initialize the SplitVector with.
     */
    HOSTONLY explicit SplitVector(std::initializer_list<T> init_list) : _location(Residency::host), d_vec(nullptr) {
-      this->_allocate(init_list.size());
-      for (size_t i = 0; i < size(); i++) {
-         _data[i] = init_list.begin()[i];
-      }
+      this->_allocate(init_list.size(), false);
+      _copy_elements(_data, init_list.begin(), size());
    }
 
    /**
@@ -308,10 +421,8 @@ public:
     * @param other The std::vector to initialize the SplitVector with.
     */
    HOSTONLY explicit SplitVector(const std::vector<T>& other) : _location(Residency::host), d_vec(nullptr) {
-      this->_allocate(other.size());
-      for (size_t i = 0; i < size(); i++) {
-         _data[i] = other[i];
-      }
+      this->_allocate(other.size(), false);
+      _copy_elements(_data, other.data(), size());
    }
 
    /**
@@ -338,10 +449,18 @@ public:
          return *this;
       }
       // Match other's size prior to copying
-      resize(other.size());
-      for (size_t i = 0; i < other.size(); i++) {
-         _data[i] = other._data[i];
+      if constexpr (std::is_trivially_copyable<T>::value) {
+         // Neither our old elements nor the values resize gives new ones survive the copy
+         if (other.size() > capacity()) {
+            clear();
+            resize(other.size());
+         } else {
+            _size_ref() = other.size();
+         }
+      } else {
+         resize(other.size());
       }
+      _copy_elements(_data, other._data, other.size());
       return *this;
    }
 #else
@@ -352,11 +471,7 @@ public:
       }
       // Match other's size prior to copying
       resize(other.size());
-      auto copySafe = [&]() -> void {
-         for (size_t i = 0; i < size(); i++) {
-            _data[i] = other._data[i];
-         }
-      };
+      auto copySafe = [&]() -> void { _copy_elements(_data, other._data, size()); };
 
       if constexpr (std::is_trivially_copyable<T>::value) {
          if (other._location == Residency::device) {
@@ -379,11 +494,7 @@ public:
       }
       // Match other's size and capacity prior to copying
       resize(other.size(), true, stream);
-      auto copySafe = [&]() -> void {
-         for (size_t i = 0; i < size(); i++) {
-            _data[i] = other._data[i];
-         }
-      };
+      auto copySafe = [&]() -> void { _copy_elements(_data, other._data, size()); };
 
       if constexpr (std::is_trivially_copyable<T>::value) {
          if (other._location == Residency::device) {
@@ -421,11 +532,12 @@ public:
 
       _deallocate_and_destroy(capacity(), _data);
       _data = other._data;
-      *_size = other.size();
-      *_capacity = other.capacity();
-      *(other._capacity) = 0;
-      *(other._size) = 0;
+      _size_ref() = other.size();
+      _capacity_ref() = other.capacity();
+      other._capacity_ref() = 0;
+      other._size_ref() = 0;
       other._data = nullptr;
+      _growth = other._growth;
       _location = other._location;
       d_vec = nullptr;
       return *this;
@@ -511,7 +623,7 @@ public:
       // This is done because _capacity would page-fault otherwise as pointed by Markus
       SPLIT_CHECK_ERR(split_gpuMemPrefetchAsync(_capacity, sizeof(size_t), split_gpuCpuDeviceId, stream));
       SPLIT_CHECK_ERR(split_gpuStreamSynchronize(stream));
-      if (*_capacity == 0) {
+      if (_capacity_ref() == 0) {
          return;
       }
 
@@ -531,7 +643,7 @@ public:
       SPLIT_CHECK_ERR(split_gpuMemPrefetchAsync(_capacity, sizeof(size_t), split_gpuCpuDeviceId, stream));
       SPLIT_CHECK_ERR(split_gpuMemPrefetchAsync(_size, sizeof(size_t), split_gpuCpuDeviceId, stream));
       SPLIT_CHECK_ERR(split_gpuStreamSynchronize(stream));
-      if (*_capacity == 0) {
+      if (_capacity_ref() == 0) {
          return;
       }
       SPLIT_CHECK_ERR(split_gpuMemPrefetchAsync(_data, capacity() * sizeof(T), split_gpuCpuDeviceId, stream));
@@ -546,7 +658,7 @@ public:
    HOSTONLY void streamAttach(split_gpuStream_t s, uint32_t flags = split_gpuMemAttachSingle) {
       SPLIT_CHECK_ERR(split_gpuStreamAttachMemAsync(s, (void*)_size, sizeof(size_t), flags));
       SPLIT_CHECK_ERR(split_gpuStreamAttachMemAsync(s, (void*)_capacity, sizeof(size_t), flags));
-      SPLIT_CHECK_ERR(split_gpuStreamAttachMemAsync(s, (void*)_data, *_capacity * sizeof(T), flags));
+      SPLIT_CHECK_ERR(split_gpuStreamAttachMemAsync(s, (void*)_data, _capacity_ref() * sizeof(T), flags));
       return;
    }
 
@@ -605,16 +717,30 @@ public:
       split::swap(_size, other._size);
       split::swap(_capacity, other._capacity);
       split::swap(_allocator, other._allocator);
+      split::swap(_growth, other._growth);
       return;
    }
 
+   /**
+    * @brief Sets how much capacity reserve(), resize() and the inserting members add when they grow.
+    *
+    * @param policy GrowthPolicy::geometric(f), GrowthPolicy::fixed_increment(n) or GrowthPolicy::exact_fit().
+    * Explicit reserve(n, true) and resize(n, true) calls still allocate exactly n.
+    */
+   HOSTONLY void set_growth_policy(const GrowthPolicy& policy) noexcept { _growth = policy; }
+
+   /**
+    * @brief Returns the growth policy of this SplitVector.
+    */
+   HOSTONLY const GrowthPolicy& growth_policy() const noexcept { return _growth; }
+
    /************STL compatibility***************/
    /**
     * @brief Returns the number of elements in the container.
     *
     * @return Number of elements in the container.
     */
-   HOSTDEVICE const size_t& size() const noexcept { return *_size; }
+   HOSTDEVICE const size_t& size() const noexcept { return _size_ref(); }
 
    /**
     * @brief Bracket accessor for accessing elements by index without bounds check.
@@ -680,12 +806,20 @@ public:
             _deallocate_and_destroy(capacity(), _data);
          }
          _data = nullptr;
-         *_capacity = 0;
-         *_size = 0;
+         _capacity_ref() = 0;
+         _size_ref() = 0;
          return;
       }
       T* _new_data;
-      _new_data = _allocate_and_construct(requested_space, T());
+      if constexpr (std::is_trivially_copyable<T>::value) {
+         // Only the new tail needs a value, the rest is overwritten by the copy right away
+         _new_data = _allocate_raw(requested_space);
+         if (_new_data != nullptr) {
+            std::uninitialized_fill_n(_new_data + size(), requested_space - size(), T());
+         }
+      } else {
+         _new_data = _allocate_and_construct(requested_space, T());
+      }
       if (_new_data == nullptr) {
          _deallocate_and_destroy(requested_space, _new_data);
          this->_deallocate();
@@ -693,9 +827,7 @@ public:
       }
 
       // Copy over
-      for (size_t i = 0; i < size(); i++) {
-         _new_data[i] = _data[i];
-      }
+      _copy_elements(_new_data, _data, size());
 
       // Deallocate old space
       _deallocate_and_destroy(capacity(), _data);
@@ -703,7 +835,7 @@ public:
       // Swap pointers & update capacity
       // Size remains the same ofc
       _data = _new_data;
-      *_capacity = requested_space;
+      _capacity_ref() = requested_space;
       return;
    }
 
@@ -718,27 +850,28 @@ public:
     * will be invalidated after a call.
     */
    void reserve(size_t requested_space, bool eco = false) {
-      size_t current_space = *_capacity;
+      size_t current_space = _capacity_ref();
       // Vector was default initialized
       if (_data == nullptr) {
          _deallocate();
-         _allocate(requested_space);
-         *_size = 0;
+         _allocate(_grown_capacity(requested_space, true));
+         _size_ref() = 0;
          return;
       }
       // Nope.
       if (requested_space <= current_space) {
-         for (size_t i = size(); i < requested_space; ++i) {
-            _allocator.construct(&_data[i], T());
+         if constexpr (std::is_trivially_copyable<T>::value) {
+            std::uninitialized_fill(_data + size(), _data + requested_space, T());
+         } else {
+            for (size_t i = size(); i < requested_space; ++i) {
+               _allocator.construct(&_data[i], T());
+            }
          }
          return;
       }
       // If the users passes eco=true we allocate
       // exactly what was requested
-      if (!eco) {
-         requested_space *= _alloc_multiplier;
-      }
-      reallocate(requested_space);
+      reallocate(_grown_capacity(requested_space, eco));
       return;
    }
 
@@ -756,11 +889,11 @@ public:
    void resize(size_t newSize, bool eco = false) {
       // Let's reserve some space and change our size
       if (newSize <= size()) {
-         *_size = newSize;
+         _size_ref() = newSize;
          return;
       }
       reserve(newSize, eco);
-      *_size = newSize;
+      _size_ref() = newSize;
       // TODO: should it set entries to zero?
    }
 
@@ -773,8 +906,8 @@ public:
     * @brief Reduce the capacity of the SplitVector to match its size.
     */
    void shrink_to_fit() {
-      size_t curr_cap = *_capacity;
-      size_t curr_size = *_size;
+      size_t curr_cap = _capacity_ref();
+      size_t curr_size = _size_ref();
 
       if (curr_cap == curr_size) {
          return;
@@ -794,8 +927,8 @@ public:
    HOSTONLY
    void reallocate(size_t requested_space, split_gpuStream_t stream = 0) {
       // Store addresses
-      const size_t __size = *_size;
-      const size_t __old_capacity = *_capacity;
+      const size_t __size = _size_ref();
+      const size_t __old_capacity = _capacity_ref();
       T* __old_data = _data;
       // Verify allocation sufficiency
       if (__size > requested_space) {
@@ -809,8 +942,8 @@ public:
             _deallocate_and_destroy(__old_capacity, __old_data);
          }
          _data = nullptr;
-         *_capacity = 0;
-         *_size = 0;
+         _capacity_ref() = 0;
+         _size_ref() = 0;
          return;
       }
       T* _new_data;
@@ -823,7 +956,7 @@ public:
       T* __new_data = _new_data;
       // Swap pointers & update capacity
       _data = _new_data;
-      *_capacity = requested_space;
+      _capacity_ref() = requested_space;
       // Perform copy on device
       if (__size > 0) {
          SPLIT_CHECK_ERR(
@@ -851,22 +984,19 @@ public:
       // Vector was default initialized
       if (_data == nullptr) {
          _deallocate();
-         _allocate(requested_space);
-         *_size = 0;
+         _allocate(_grown_capacity(requested_space, true));
+         _size_ref() = 0;
          return;
       }
       // Already has sufficient capacity?
-      const size_t current_space = *_capacity;
+      const size_t current_space = _capacity_ref();
       if (requested_space <= current_space) {
          return;
       }
       // Reallocate.
       // If the users passes eco=true we allocate
       // exactly what was requested
-      if (!eco) {
-         requested_space *= _alloc_multiplier;
-      }
-      reallocate(requested_space, stream);
+      reallocate(_grown_capacity(requested_space, eco), stream);
       return;
    }
 
@@ -885,11 +1015,11 @@ public:
    void resize(size_t newSize, bool eco = false, split_gpuStream_t stream = 0) {
       // Let's reserve some space and change our size
       if (newSize <= size()) {
-         *_size = newSize;
+         _size_ref() = newSize;
          return;
       }
       reserve(newSize, eco, stream);
-      *_size = newSize;
+      _size_ref() = newSize;
       // TODO: should it set entries to zero?
    }
 
@@ -908,7 +1038,7 @@ public:
             _allocator.construct(&_data[i], T());
          }
       }
-      *_size = newSize;
+      _size_ref() = newSize;
    }
 
    /**
@@ -922,8 +1052,8 @@ public:
     */
    HOSTONLY
    void shrink_to_fit(split_gpuStream_t stream = 0) {
-      size_t curr_cap = *_capacity;
-      size_t curr_size = *_size;
+      size_t curr_cap = _capacity_ref();
+      size_t curr_size = _size_ref();
 
       if (curr_cap == curr_size) {
          return;
@@ -958,7 +1088,7 @@ public:
             (_data + --i)->~T();
          }
       }
-      *_size = end;
+      _size_ref() = end;
    }
 
    /**
@@ -971,7 +1101,7 @@ public:
             _data[i].~T();
          }
       }
-      *_size = 0;
+      _size_ref() = 0;
       return;
    }
 
@@ -981,7 +1111,7 @@ public:
     * @return The capacity of the SplitVector.
     */
    HOSTDEVICE
-   inline size_t capacity() const noexcept { return *_capacity; }
+   inline size_t capacity() const noexcept { return _capacity_ref(); }
 
    /**
     * @brief Get a reference to the last element of the SplitVector.
@@ -989,7 +1119,7 @@ public:
     * @return Reference to the last element.
     */
    HOSTDEVICE
-   T& back() noexcept { return _data[*_size - 1]; }
+   T& back() noexcept { return _data[_size_ref() - 1]; }
 
    /**
     * @brief Get a const reference to the last element of the SplitVector.
@@ -997,7 +1127,7 @@ public:
     * @return Const reference to the last element.
     */
    HOSTDEVICE
-   const T& back() const noexcept { return _data[*_size - 1]; }
+   const T& back() const noexcept { return _data[_size_ref() - 1]; }
 
    /**
     * @brief Get a reference to the first element of the SplitVector.
@@ -1060,6 +1190,41 @@ public:
       return;
    }
 
+#ifdef __cpp_lib_atomic_ref
+   /**
+    * @brief Push an element to the back of the SplitVector from one of many host threads.
+    *
+    * A slot is reserved with a CAS on the size, so this never grows the vector: when the reserved
+    * capacity is exhausted it returns false and leaves the vector untouched. Growing relocates
+    * the data other threads are writing to, so the caller has to reserve more space after all
+    * threads are done and retry the failed elements. Elements are only guaranteed to be visible
+    * to other threads once they have synchronized with the writer, e.g. by joining it.
+    *
+    * @param val The value to push to the back.
+    * @return false if the vector is full.
+    */
+   HOSTONLY
+   bool concurrent_push_back(const T& val) noexcept { return concurrent_append(&val, 1); }
+
+   /**
+    * @brief Appends the n elements starting at first as one contiguous block, see concurrent_push_back.
+    *
+    * @return false, appending nothing, if fewer than n slots are left.
+    */
+   HOSTONLY
+   bool concurrent_append(const T* first, size_t n) noexcept {
+      std::atomic_ref<size_t> size(_size_ref());
+      size_t old = size.load(std::memory_order_relaxed);
+      do {
+         if (n > capacity() - old) {
+            return false;
+         }
+      } while (!size.compare_exchange_weak(old, old + n, std::memory_order_relaxed));
+      std::copy(first, first + n, _data + old);
+      return true;
+   }
+#endif
+
 #ifndef SPLIT_CPU_ONLY_MODE
    /**
     * @brief Push an element to the back of the SplitVector on the device.
@@ -1286,7 +1451,7 @@ public:
          _data[i + 1] = _data[i];
       }
       _data[index] = val;
-      *_size = *_size + 1;
+      _size_ref() = _size_ref() + 1;
       return iterator(_data + index);
    }
 
@@ -1312,10 +1477,8 @@ public:
       resize(newSize);
 
       it = begin().data() + index;
-      iterator last = it.data() + oldsize;
-      std::copy_backward(it, last, last.data() + elements);
-      last = it.data() + elements;
-      std::fill(it, last, val);
+      _move_elements(it.data() + elements, it.data(), oldsize - index);
+      std::fill(it.data(), it.data() + elements, val);
       iterator retval = &_data[index];
       return retval;
    }
@@ -1343,8 +1506,14 @@ public:
       resize(size() + count);
 
       iterator retval = &_data[index];
-      std::move(retval, iterator(&_data[old_size]), retval.data() + count);
-      std::copy(p0, p1, retval);
+      _move_elements(retval.data() + count, retval.data(), old_size - index);
+      if constexpr (std::is_pointer<InputIterator>::value) {
+         _copy_elements(retval.data(), p0, count);
+      } else if constexpr (std::is_same<InputIterator, iterator>::value) {
+         _copy_elements(retval.data(), p0.data(), count);
+      } else {
+         std::copy(p0, p1, retval);
+      }
       return retval;
    }
 
@@ -1472,18 +1641,23 @@ public:
    HOSTDEVICE
    iterator erase(iterator it) noexcept {
       const int64_t index = it.data() - begin().data();
-      if constexpr (!std::is_trivial<T>::value) {
+      if constexpr (!std::is_trivially_copyable<T>::value) {
          _data[index].~T();
          for (size_t i = index; i < size() - 1; i++) {
             new (&_data[i]) T(_data[i + 1]);
             _data[i + 1].~T();
          }
       } else {
+#ifdef SPLIT_CPU_ONLY_MODE
+         std::memmove(static_cast<void*>(&_data[index]), static_cast<const void*>(&_data[index + 1]),
+                      (size() - 1 - index) * sizeof(T));
+#else
          for (auto i = static_cast<size_t>(index); i < size() - 1; i++) {
             new (&_data[i]) T(_data[i + 1]);
          }
+#endif
       }
-      *_size -= 1;
+      _size_ref() -= 1;
       iterator retval = &_data[index];
       return retval;
    }
@@ -1502,7 +1676,7 @@ public:
       const int64_t range = end - start;
 
       const size_t sz = size();
-      if constexpr (!std::is_trivial<T>::value) {
+      if constexpr (!std::is_trivially_copyable<T>::value) {
          for (int64_t i = start; i < end; i++) {
             _data[i].~T();
          }
@@ -1511,11 +1685,16 @@ public:
             _data[i + range].~T();
          }
       } else {
+#ifdef SPLIT_CPU_ONLY_MODE
+         std::memmove(static_cast<void*>(&_data[start]), static_cast<const void*>(&_data[end]),
+                      (sz - end) * sizeof(T));
+#else
          for (size_t i = start; i < sz - range; ++i) {
             new (&_data[i]) T(_data[i + range]);
          }
+#endif
       }
-      *_size -= end - start;
+      _size_ref() -= end - start;
       iterator it = &_data[start];
       return it;
    }
@@ -1537,9 +1716,10 @@ public:
       if (index < 0 || index > static_cast<int64_t>(size())) {
          throw new std::out_of_range("Out of range");
       }
-      resize(size() + 1);
+      const size_t old_size = size();
+      resize(old_size + 1);
       iterator it = &_data[index];
-      std::move(it.data(), end().data(), it.data() + 1);
+      _move_elements(it.data() + 1, it.data(), old_size - index);
       _allocator.destroy(it.data());
       _allocator.construct(it.data(), args...);
       return it;
@@ -0,0 +1,293 @@
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include <unistd.h>
+#include "../../include/hashinator/hashinator.h"
+
+using namespace std::chrono;
+using namespace Hashinator;
+typedef uint32_t val_type;
+typedef uint64_t key_type;
+using hashmap= Hashmap<key_type,val_type>;
+
+// Operations are timed in batches of this many; a single op is too short for the clock
+constexpr size_t BATCH = 64;
+// Timesteps of the clear and reallocate workloads
+constexpr size_t CYCLES = 8;
+
+struct Config{
+   int minPow=10;
+   // 2^30 buckets of 16 bytes take 16 GB, so the full range is opt in with --max-pow 30
+   int maxPow=24;
+   int reps=3;
+   bool json=false;
+   std::vector<float> loadFactors={0.25,0.5,0.75,0.9,0.95};
+   std::vector<std::string> workloads={"insert","retrieve","erase","mixed","churn","clear","reallocate",
+                                       "batch_insert","batch_erase"};
+};
+
+struct Result{
+   std::string workload;
+   int sizePower;
+   float loadFactor;
+   size_t ops;
+   double seconds;
+   double p50;
+   double p99;
+   size_t rss;
+   size_t peakRss;
+};
+
+// Distinct keys that are spread over the whole key space: splitmix64 is a bijection
+key_type key_of(uint64_t i){
+   i += 0x9e3779b97f4a7c15ull;
+   i = (i ^ (i >> 30)) * 0xbf58476d1ce4e5b9ull;
+   i = (i ^ (i >> 27)) * 0x94d049bb133111ebull;
+   return i ^ (i >> 31);
+}
+
+size_t rss_bytes(){
+   long pages=0,resident=0;
+   FILE* f = fopen("/proc/self/statm","r");
+   if (f){
+      if (fscanf(f,"%ld %ld",&pages,&resident)!=2){resident=0;}
+      fclose(f);
+   }
+   return (size_t)resident*(size_t)sysconf(_SC_PAGESIZE);
+}
+
+size_t peak_rss_bytes(){
+   struct rusage usage;
+   getrusage(RUSAGE_SELF,&usage);
+   return (size_t)usage.ru_maxrss*1024;
+}
+
+// Runs op(i) for i in [0,n) and records the per op time of every batch in ns
+template <class Fn>
+double timeBatches(size_t n, std::vector<double>& latencies, Fn op){
+   auto start = steady_clock::now();
+   auto last = start;
+   for (size_t b=0; b<n; b+=BATCH){
+      const size_t e = std::min(n,b+BATCH);
+      for (size_t i=b; i<e; ++i){
+         op(i);
+      }
+      auto now = steady_clock::now();
+      latencies.push_back(duration_cast<nanoseconds>(now-last).count()/(double)(e-b));
+      last = now;
+   }
+   return duration_cast<nanoseconds>(last-start).count()*1e-9;
+}
+
+void fill(hashmap& hmap, size_t n){
+   for (size_t i=0; i<n; ++i){
+      hmap[key_of(i)]=(val_type)i;
+   }
+}
+
+// One repetition of a workload on a table of 2^sizePower buckets filled to loadFactor
+double runOnce(const std::string& workload, int sizePower, size_t n, std::vector<double>& latencies, size_t& rss){
+   hashmap hmap(sizePower);
+   volatile val_type sink=0;
+   double t=0;
+   if (workload=="clear" || workload=="reallocate"){
+      // Per timestep scratch map: empty it, either in place or by swapping in a new table, and refill it.
+      // Latencies are per insert of every cycle.
+      for (size_t c=0; c<CYCLES; ++c){
+         auto start = steady_clock::now();
+         if (workload=="clear"){
+            hmap.clear();
+         }else{
+            hashmap fresh(sizePower);
+            hmap.swap(fresh);
+         }
+         for (size_t i=0; i<n; ++i){
+            hmap[key_of(i+c*n)]=(val_type)i;
+         }
+         const double cycle = duration_cast<nanoseconds>(steady_clock::now()-start).count()*1e-9;
+         latencies.push_back(cycle*1e9/n);
+         t+=cycle;
+      }
+   }else if (workload=="batch_insert" || workload=="batch_erase"){
+      // Whole batches through the Hasher kernels, so the latencies are per op of the batch
+      std::vector<key_type> keys(n);
+      for (size_t i=0; i<n; ++i){
+         keys[i]=key_of(i);
+      }
+      if (workload=="batch_erase"){
+         fill(hmap,n);
+      }
+      auto start = steady_clock::now();
+      if (workload=="batch_insert"){
+         hmap.insertIndex(keys.data(),n);
+      }else{
+         hmap.erase(keys.data(),n);
+      }
+      t=duration_cast<nanoseconds>(steady_clock::now()-start).count()*1e-9;
+      latencies.push_back(t*1e9/n);
+   }else if (workload=="insert"){
+      t=timeBatches(n,latencies,[&](size_t i){hmap[key_of(i)]=(val_type)i;});
+   }else{
+      fill(hmap,n);
+      if (workload=="retrieve"){
+         // Half of the lookups miss
+         t=timeBatches(n,latencies,[&](size_t i){
+            auto it = hmap.find(key_of(i%2 ? i : i+n));
+            if (it!=hmap.end()){sink=sink+it->second;}
+         });
+      }else if (workload=="erase"){
+         t=timeBatches(n,latencies,[&](size_t i){hmap.erase(key_of(i));});
+      }else if (workload=="mixed"){
+         // 80% lookups, 10% inserts of new keys and 10% erases of the oldest keys, so the fill stays put
+         size_t oldest=0,next=n;
+         t=timeBatches(n,latencies,[&](size_t i){
+            const uint64_t r = key_of(i+(1ull<<40))%10;
+            if (r<8){
+               auto it = hmap.find(key_of(oldest+(i%(next-oldest))));
+               if (it!=hmap.end()){sink=sink+it->second;}
+            }else if (r==8){
+               hmap[key_of(next)]=(val_type)next;
+               next++;
+            }else if (next-oldest>1){
+               hmap.erase(key_of(oldest));
+               oldest++;
+            }
+         });
+      }else if (workload=="churn"){
+         // Every op replaces the oldest key with a new one, which keeps producing tombstones
+         t=timeBatches(n,latencies,[&](size_t i){
+            hmap.erase(key_of(i));
+            hmap[key_of(i+n)]=(val_type)i;
+         });
+      }
+   }
+   rss=rss_bytes();
+   return t;
+}
+
+double percentile(std::vector<double>& v, double p){
+   if (v.empty()){return 0;}
+   const size_t k = std::min(v.size()-1,(size_t)(p*v.size()));
+   std::nth_element(v.begin(),v.begin()+k,v.end());
+   return v[k];
+}
+
+Result run(const Config& cfg, const std::string& workload, int sizePower, float lf){
+   const size_t n = std::max<size_t>(1,(size_t)(lf*(double)(1ul<<sizePower)));
+   const size_t ops = (workload=="clear" || workload=="reallocate") ? n*CYCLES : n;
+   std::vector<double> latencies;
+   std::vector<double> times;
+   size_t rss=0;
+   for (int r=0; r<cfg.reps; ++r){
+      times.push_back(runOnce(workload,sizePower,n,latencies,rss));
+   }
+   Result res{workload,sizePower,lf,ops,0,0,0,rss,peak_rss_bytes()};
+   res.seconds=percentile(times,0.5);
+   res.p50=percentile(latencies,0.5);
+   res.p99=percentile(latencies,0.99);
+   return res;
+}
+
+void print(const Config& cfg, const Result& r, bool first){
+   const double mops = r.ops/r.seconds*1e-6;
+   const double nsPerOp = r.seconds*1e9/r.ops;
+   if (cfg.json){
+      printf("%s\n  {\"workload\": \"%s\", \"size_power\": %d, \"load_factor\": %.2f, \"ops\": %zu, "
+             "\"mops\": %.3f, \"ns_per_op\": %.2f, \"p50_ns\": %.2f, \"p99_ns\": %.2f, "
+             "\"rss_bytes\": %zu, \"peak_rss_bytes\": %zu}",
+             first?"":",",r.workload.c_str(),r.sizePower,r.loadFactor,r.ops,mops,nsPerOp,r.p50,r.p99,r.rss,r.peakRss);
+   }else{
+      printf("%s,%d,%.2f,%zu,%.3f,%.2f,%.2f,%.2f,%zu,%zu\n",
+             r.workload.c_str(),r.sizePower,r.loadFactor,r.ops,mops,nsPerOp,r.p50,r.p99,r.rss,r.peakRss);
+   }
+   fflush(stdout);
+}
+
+template <class T, class Parse>
+std::vector<T> splitList(const char* arg, Parse parse){
+   std::vector<T> out;
+   std::string s(arg);
+   size_t pos=0;
+   while (pos<=s.size()){
+      size_t comma = s.find(',',pos);
+      if (comma==std::string::npos){comma=s.size();}
+      if (comma>pos){out.push_back(parse(s.substr(pos,comma-pos)));}
+      pos=comma+1;
+   }
+   return out;
+}
+
+void usage(const char* name){
+   fprintf(stderr,
+           "usage: %s [--min-pow P] [--max-pow P] [--lf 0.25,0.5,...] [--reps R] [--format csv|json]\n"
+           "          [--workloads insert,retrieve,erase,mixed,churn,clear,reallocate,batch_insert,batch_erase]\n"
+           "sizes default to 2^10..2^24 buckets, --max-pow 30 covers up to 2^30 (16 GB per table)\n",
+           name);
+}
+
+// CPU-only single threaded benchmark suite meant for tracking regressions on machines without a GPU.
+// Each workload runs on tables of 2^P buckets, P in [min-pow,max-pow] (10 and 24 unless given, up to
+// 30 with --max-pow 30), filled to every load factor.
+// Output (csv, or a json array of the same fields):
+//    workload,size_power,load_factor,ops,mops,ns_per_op,p50_ns,p99_ns,rss_bytes,peak_rss_bytes
+// ns_per_op comes from the median repetition, p50/p99 are per op times of batches of 64 operations.
+// clear and reallocate refill the map for 8 timesteps, emptying it with clear() or with a new table.
+// batch_insert and batch_erase run insertIndex and erase(keys, n) on the host threads of the Hasher;
+// insertIndex keeps its default target load factor, so it may grow the table once up front.
+int main(int argc, char* argv[]){
+   Config cfg;
+   for (int i=1; i<argc; ++i){
+      const bool hasValue = i+1<argc;
+      if (!strcmp(argv[i],"--min-pow") && hasValue){
+         cfg.minPow=atoi(argv[++i]);
+      }else if (!strcmp(argv[i],"--max-pow") && hasValue){
+         cfg.maxPow=atoi(argv[++i]);
+      }else if (!strcmp(argv[i],"--reps") && hasValue){
+         cfg.reps=std::max(1,atoi(argv[++i]));
+      }else if (!strcmp(argv[i],"--lf") && hasValue){
+         cfg.loadFactors=splitList<float>(argv[++i],[](const std::string& s){return std::stof(s);});
+      }else if (!strcmp(argv[i],"--workloads") && hasValue){
+         cfg.workloads=splitList<std::string>(argv[++i],[](const std::string& s){return s;});
+      }else if (!strcmp(argv[i],"--format") && hasValue){
+         cfg.json=!strcmp(argv[++i],"json");
+      }else{
+         usage(argv[0]);
+         return 1;
+      }
+   }
+   for (const auto& w : cfg.workloads){
+      const Config all;
+      if (std::find(all.workloads.begin(),all.workloads.end(),w)==all.workloads.end()){
+         fprintf(stderr,"unknown workload %s\n",w.c_str());
+         return 1;
+      }
+   }
+   if (cfg.minPow<1 || cfg.maxPow>30 || cfg.minPow>cfg.maxPow){
+      fprintf(stderr,"size powers must satisfy 1 <= min-pow <= max-pow <= 30\n");
+      return 1;
+   }
+
+   bool first=true;
+   if (cfg.json){
+      printf("[");
+   }else{
+      printf("workload,size_power,load_factor,ops,mops,ns_per_op,p50_ns,p99_ns,rss_bytes,peak_rss_bytes\n");
+   }
+   for (int p=cfg.minPow; p<=cfg.maxPow; ++p){
+      for (float lf : cfg.loadFactors){
+         for (const auto& w : cfg.workloads){
+            print(cfg,run(cfg,w,p,lf),first);
+            first=false;
+         }
+      }
+   }
+   if (cfg.json){
+      printf("\n]\n");
+   }
+   return 0;
+}
@@ -0,0 +1,78 @@
+#include <iostream>
+#include <stdlib.h>
+#include <chrono>
+#include <random>
+#include "../../include/hashinator/hashinator.h"
+constexpr int R = 5;
+
+using namespace std::chrono;
+using namespace Hashinator;
+typedef uint32_t val_type;
+typedef uint32_t key_type;
+typedef split::SplitVector<hash_pair<key_type,val_type>> vector ;
+typedef split::SplitVector<key_type> key_vec;
+typedef split::SplitVector<val_type> val_vec;
+using hashmap= Hashmap<key_type,val_type>;
+using hugemap= Hashmap<key_type,val_type,std::numeric_limits<key_type>::max(),std::numeric_limits<key_type>::max()-1,
+                       HashFunctions::Fibonacci<key_type>,void,split::split_hugepage_allocator<MapInfo>>;
+
+template <class Fn, class ... Args>
+auto timeMe(Fn fn, Args && ... args){
+   std::chrono::time_point<std::chrono::_V2::system_clock, std::chrono::_V2::system_clock::duration> start,stop;
+   double total_time=0;
+   start = std::chrono::high_resolution_clock::now();
+   fn(args...);
+   stop = std::chrono::high_resolution_clock::now();
+   auto duration = duration_cast<microseconds>(stop- start).count();
+   total_time+=duration;
+   return total_time;
+}
+
+// Same sequence as the realistic benchmark
+template <class Map>
+void workload(Map& hmap, hash_pair<key_type,val_type>*src,key_type* keys, val_type* vals,size_t n){
+   hmap.insert_partitioned(src,n);
+   hmap.retrieve(keys,vals,n);
+   for (size_t i=0; i<n; ++i){
+      hmap.erase(keys[i]);
+   }
+   hmap.insert_partitioned(src,n);
+   hmap.retrieve(keys,vals,n);
+}
+
+template <class Map>
+void report(const char* name,int sz,vector& src,key_vec& keys,val_vec& vals){
+   const size_t n=keys.size();
+   double tLookup=0,tWorkload=0;
+   for (int i =0; i<R; i++){
+      Map hmap(sz+1);
+      tWorkload+=timeMe([&](){workload(hmap,src.data(),keys.data(),vals.data(),n);});
+      tLookup+=timeMe([&](){hmap.retrieve(keys.data(),vals.data(),n);});
+   }
+   printf("%s %.2f %.2f\n",name,n/(tLookup/R),n/(tWorkload/R));
+}
+
+// CPU-only benchmark of the bucket storage page size on the realistic workload.
+// Output: pages random-lookups[Mops/s] realistic-workload[Mops/s]
+int main(int argc, char* argv[]){
+   int sz= 26;
+   if (argc>=2){
+      sz=atoi(argv[1]);
+   }
+   const size_t N = 1ul<<sz;
+   std::mt19937 gen(1);
+   std::uniform_int_distribution<key_type> dist(1, std::numeric_limits<key_type>::max()-2);
+   vector src(N);
+   key_vec keys(N);
+   val_vec vals(N);
+   for (size_t i=0; i<N; ++i){
+      keys[i]=dist(gen);
+      src[i]={keys[i],keys[i]/2};
+   }
+   // Probe in a different order than insertion
+   std::shuffle(keys.data(),keys.data()+N,gen);
+
+   report<hashmap>("4K",sz,src,keys,vals);
+   report<hugemap>("huge",sz,src,keys,vals);
+   return 0;
+}
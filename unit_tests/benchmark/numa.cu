@@ -0,0 +1,126 @@
+#include <iostream>
+#include <stdlib.h>
+#include <chrono>
+#include <random>
+#include "../../include/hashinator/hashinator.h"
+constexpr int R = 5;
+
+using namespace std::chrono;
+using namespace Hashinator;
+typedef uint32_t val_type;
+typedef uint32_t key_type;
+typedef split::SplitVector<key_type> key_vec;
+typedef split::SplitVector<val_type> val_vec;
+using hashmap= Hashmap<key_type,val_type>;
+using split::tools::numa_policy;
+
+template <class Fn, class ... Args>
+auto timeMe(Fn fn, Args && ... args){
+   std::chrono::time_point<std::chrono::_V2::system_clock, std::chrono::_V2::system_clock::duration> start,stop;
+   double total_time=0;
+   start = std::chrono::high_resolution_clock::now();
+   fn(args...);
+   stop = std::chrono::high_resolution_clock::now();
+   auto duration = duration_cast<microseconds>(stop- start).count();
+   total_time+=duration;
+   return total_time;
+}
+
+// Lookups of keys [begin,end) on the calling thread. concurrent_find runs no cleanup, so many
+// threads can share the map.
+void findRange(const hashmap& hmap,const key_vec& keys, val_vec& vals,size_t begin,size_t end){
+   for (size_t i=begin; i<end; ++i){
+      hmap.concurrent_find(keys[i],vals[i]);
+   }
+}
+
+// Lookups of all keys spread over all host threads
+double benchRetrieve(const hashmap& hmap,key_vec& keys, val_vec& vals){
+   double t=0;
+   for (int i =0; i<R; i++){
+      t+=timeMe([&](){
+         split::tools::parallel_for(keys.size(),[&](size_t begin,size_t end,size_t){
+            findRange(hmap,keys,vals,begin,end);
+         },1ul<<16);
+      });
+   }
+   return t/(double)R;
+}
+
+double benchInsert(key_vec& keys, val_vec& vals){
+   double t=0;
+   for (int i =0; i<R; i++){
+      hashmap hmap;
+      t+=timeMe([&](){hmap.insert_partitioned(keys.data(),vals.data(),keys.size());});
+   }
+   return t/(double)R;
+}
+
+const char* name(numa_policy policy){
+   switch (policy){
+      case numa_policy::interleave: return "interleave";
+      case numa_policy::blocked: return "blocked";
+      default: return "none";
+   }
+}
+
+// CPU-only benchmark of bucket placement on multi socket hosts.
+// Output, in Mops/s:
+//    local|remote threadNode memoryNode lookups      single thread lookups with the buckets bound to memoryNode
+//    policy name insert lookups                     partitioned insert and parallel lookups per NUMA policy
+int main(int argc, char* argv[]){
+   int sz= 24;
+   if (argc>=2){
+      sz=atoi(argv[1]);
+   }
+   const size_t N = 1ul<<sz;
+   const size_t nNodes = split::tools::numa_nodes();
+   std::mt19937 gen(1);
+   std::uniform_int_distribution<key_type> dist(0, std::numeric_limits<key_type>::max()-2);
+
+   key_vec keys(N);
+   val_vec vals(N);
+   for (size_t i=0; i<N; ++i){
+      keys[i]=dist(gen);
+      vals[i]=keys[i]/2;
+   }
+   printf("nodes %zu threads %zu\n",nNodes,split::tools::host_threads());
+
+   // Local versus remote lookups: migrate the buckets to one node and probe them from another
+   {
+      hashmap hmap(sz+1);
+      hmap.insert(keys.data(),vals.data(),N);
+      void* buckets = hmap.expose_bucketdata<false>();
+      const size_t bytes = hmap.bucket_count()*sizeof(hash_pair<key_type,val_type>);
+      for (size_t memNode=0; memNode<nNodes; ++memNode){
+         if (nNodes>1 && !split::tools::numa_bind_node(buckets,bytes,memNode)){
+            printf("could not bind to node %zu\n",memNode);
+            continue;
+         }
+         for (size_t threadNode=0; threadNode<nNodes; ++threadNode){
+            std::thread worker([&](){
+               split::tools::pin_thread_to_node(threadNode);
+               double t=0;
+               for (int i =0; i<R; i++){
+                  t+=timeMe([&](){findRange(hmap,keys,vals,0,N);});
+               }
+               printf("%s %zu %zu %.2f\n",threadNode==memNode?"local":"remote",threadNode,memNode,N/(t/R));
+            });
+            worker.join();
+         }
+      }
+   }
+
+   // Whole table placement policies with all threads working
+   for (numa_policy policy : {numa_policy::none,numa_policy::interleave,numa_policy::blocked}){
+      split::tools::set_host_numa_policy(policy);
+      double tInsert=benchInsert(keys,vals);
+      hashmap hmap;
+      hmap.insert_partitioned(keys.data(),vals.data(),N);
+      hmap.performCleanupTasks();
+      double tRetrieve=benchRetrieve(hmap,keys,vals);
+      printf("policy %s %.2f %.2f\n",name(policy),N/tInsert,N/tRetrieve);
+   }
+   split::tools::set_host_numa_policy(numa_policy::none);
+   return 0;
+}
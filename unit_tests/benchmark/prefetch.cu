@@ -0,0 +1,106 @@
+#include <iostream>
+#include <stdlib.h>
+#include <chrono>
+#include <random>
+#include "../../include/hashinator/hashinator.h"
+constexpr int R = 5;
+
+using namespace std::chrono;
+using namespace Hashinator;
+typedef uint32_t val_type;
+typedef uint32_t key_type;
+typedef split::SplitVector<key_type> key_vec;
+typedef split::SplitVector<val_type> val_vec;
+using hashmap= Hashmap<key_type,val_type>;
+
+template <class Fn, class ... Args>
+auto timeMe(Fn fn, Args && ... args){
+   std::chrono::time_point<std::chrono::_V2::system_clock, std::chrono::_V2::system_clock::duration> start,stop;
+   double total_time=0;
+   start = std::chrono::high_resolution_clock::now();
+   fn(args...);
+   stop = std::chrono::high_resolution_clock::now();
+   auto duration = duration_cast<microseconds>(stop- start).count();
+   total_time+=duration;
+   return total_time;
+}
+
+template <int WINDOW>
+double benchRetrieve(hashmap& hmap,key_vec& keys, val_vec& vals){
+   double t=0;
+   for (int i =0; i<R; i++){
+      t+=timeMe([&](){hmap.template retrieve<WINDOW>(keys.data(),vals.data(),keys.size());});
+   }
+   return t/(double)R;
+}
+
+#ifdef __cpp_impl_coroutine
+LookupTask lookupLoop(hashmap& hmap,key_vec& keys, val_vec& vals,size_t first,size_t stride){
+   for (size_t i=first; i<keys.size(); i+=stride){
+      auto it = co_await hmap.async_find(keys[i]);
+      vals[i]=it->second;
+   }
+}
+
+double benchCoroutines(hashmap& hmap,key_vec& keys, val_vec& vals,size_t inFlight){
+   double t=0;
+   for (int i =0; i<R; i++){
+      t+=timeMe([&](){
+         LookupScheduler scheduler;
+         for (size_t c=0; c<inFlight; ++c){
+            scheduler.spawn(lookupLoop(hmap,keys,vals,c,inFlight));
+         }
+         scheduler.run();
+      });
+   }
+   return t/(double)R;
+}
+#endif
+
+template <int WINDOW>
+void report(hashmap& hmap,key_vec& keys, val_vec& vals,double baseline){
+   double t=benchRetrieve<WINDOW>(hmap,keys,vals);
+   printf("%d %d %.3f\n",WINDOW,(int)t,baseline/t);
+}
+
+// CPU-only benchmark of the group-prefetched batch retrieve against its window size
+// and of coroutine-interleaved lookups against the number of tasks in flight.
+// Output: [coro] window|tasks time[us] speedup-vs-window-1
+int main(int argc, char* argv[]){
+   int sz= 24;
+   if (argc>=2){
+      sz=atoi(argv[1]);
+   }
+   const size_t N = 1ul<<sz;
+   std::mt19937 gen(1);
+   std::uniform_int_distribution<key_type> dist(0, std::numeric_limits<key_type>::max()-2);
+
+   key_vec keys(N);
+   val_vec vals(N);
+   for (size_t i=0; i<N; ++i){
+      keys[i]=dist(gen);
+      vals[i]=keys[i]/2;
+   }
+   hashmap hmap(sz+1);
+   hmap.insert(keys.data(),vals.data(),N);
+   // Query in a different random order than insertion
+   std::shuffle(keys.data(),keys.data()+N,gen);
+
+   double baseline=benchRetrieve<1>(hmap,keys,vals);
+   printf("%d %d %.3f\n",1,(int)baseline,1.0);
+   report<2>(hmap,keys,vals,baseline);
+   report<4>(hmap,keys,vals,baseline);
+   report<8>(hmap,keys,vals,baseline);
+   report<16>(hmap,keys,vals,baseline);
+   report<32>(hmap,keys,vals,baseline);
+   report<64>(hmap,keys,vals,baseline);
+
+#ifdef __cpp_impl_coroutine
+   // Same lookups issued from interleaved coroutines, one line per number of tasks in flight
+   for (size_t inFlight : {1,4,16,64}){
+      double t=benchCoroutines(hmap,keys,vals,inFlight);
+      printf("coro %zu %d %.3f\n",inFlight,(int)t,baseline/t);
+   }
+#endif
+   return 0;
+}
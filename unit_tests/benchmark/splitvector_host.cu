@@ -0,0 +1,114 @@
+#include <iostream>
+#include <stdlib.h>
+#include <chrono>
+#include <vector>
+#define SPLIT_CPU_ONLY_MODE
+#include "../../include/splitvector/splitvec.h"
+constexpr int R = 5;
+
+using namespace std::chrono;
+typedef size_t val_type;
+typedef split::SplitVector<val_type> split_vector;
+typedef std::vector<val_type> std_vector;
+
+template <class Fn, class ... Args>
+auto timeMe(Fn fn, Args && ... args){
+   std::chrono::time_point<std::chrono::_V2::system_clock, std::chrono::_V2::system_clock::duration> start,stop;
+   double total_time=0;
+   start = std::chrono::high_resolution_clock::now();
+   fn(args...);
+   stop = std::chrono::high_resolution_clock::now();
+   auto duration = duration_cast<nanoseconds>(stop- start).count();
+   total_time+=duration;
+   return total_time;
+}
+
+// Constructs and destroys n vectors of len elements
+template <class VEC>
+double benchConstruct(size_t n, size_t len){
+   double t=0;
+   volatile size_t sink=0;
+   for (int i =0; i<R; i++){
+      t+=timeMe([&](){
+         for (size_t j=0; j<n; ++j){
+            VEC v(len);
+            sink=sink+v.size();
+         }
+      });
+   }
+   return t/(double)R/n;
+}
+
+// Sums vec with size() in the loop condition, as the probe loops of Hashinator do
+template <class VEC>
+double benchSizeLoop(VEC& vec){
+   double t=0;
+   volatile val_type sink=0;
+   for (int i =0; i<R; i++){
+      t+=timeMe([&](){
+         val_type sum=0;
+         // Stores of size_t may alias the size, so it is reloaded every iteration
+         for (size_t j=0; j<vec.size(); ++j){
+            sum+=vec[j];
+            vec[j]=sum;
+         }
+         sink=sink+sum;
+      });
+   }
+   return t/(double)R/vec.size();
+}
+
+// Copy construction, copy assignment and inserting a range into the middle, per element
+template <class VEC>
+void benchBulk(size_t len, double& tCopy, double& tAssign, double& tInsert){
+   VEC src(len,1);
+   VEC dst;
+   volatile val_type sink=0;
+   tCopy=tAssign=tInsert=0;
+   for (int i =0; i<R; i++){
+      tCopy+=timeMe([&](){
+         VEC copy(src);
+         sink=sink+copy[len-1];
+      });
+      dst.clear();
+      tAssign+=timeMe([&](){dst=src;});
+      VEC half(len/2,2);
+      half.reserve(len);
+      tInsert+=timeMe([&](){half.insert(half.begin()+len/4,src.begin(),src.begin()+len/2);});
+   }
+   tCopy/=R*(double)len;
+   tAssign/=R*(double)len;
+   tInsert/=R*(double)len;
+}
+
+// CPU-only benchmark of SplitVector metadata handling and bulk element moves against std::vector.
+// Output, in ns:
+//    construct len splitvector std::vector      per construction and destruction of a vector of len elements
+//    sizeloop len splitvector std::vector       per element of a loop that re-reads size() every iteration
+//    copy|assign|insert len splitvector std::vector   per element of a copy, an assignment or a range insert
+int main(int argc, char* argv[]){
+   size_t n = 1<<20;
+   int maxPower = 26;
+   if (argc>=2){
+      n=atol(argv[1]);
+   }
+   if (argc>=3){
+      maxPower=atoi(argv[2]);
+   }
+   for (size_t len : {0ul,8ul,64ul}){
+      printf("construct %zu %.2f %.2f\n",len,benchConstruct<split_vector>(n,len),benchConstruct<std_vector>(n,len));
+   }
+   for (size_t len : {1ul<<10,1ul<<20}){
+      split_vector a(len,1);
+      std_vector b(len,1);
+      printf("sizeloop %zu %.3f %.3f\n",len,benchSizeLoop(a),benchSizeLoop(b));
+   }
+   for (int p=10; p<=maxPower; p+=4){
+      const size_t len = 1ul<<p;
+      double sc,sa,si,vc,va,vi;
+      benchBulk<split_vector>(len,sc,sa,si);
+      benchBulk<std_vector>(len,vc,va,vi);
+      printf("copy %zu %.3f %.3f\nassign %zu %.3f %.3f\ninsert %zu %.3f %.3f\n",len,sc,vc,len,sa,va,len,si,vi);
+   }
+   return 0;
+}
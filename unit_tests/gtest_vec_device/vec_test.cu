@@ -213,7 +213,8 @@ TEST(Vector_Functionality , Shrink_to_Fit){
    size_t initial_size=a.size();
    size_t initial_cap=a.capacity();
 
-   for (int i =0 ; i< 1024; i++){
+   // Capacity doubles from 1, so stop short of a power of two
+   for (int i =0 ; i< 1000; i++){
       a.push_back(i);
    }
 
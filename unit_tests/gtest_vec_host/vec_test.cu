@@ -2,11 +2,18 @@
 #include <stdlib.h>
 #include <chrono>
 #include <vector>
+#include <thread>
 #include <gtest/gtest.h>
 #ifndef SPLIT_CPU_ONLY_MODE
 #define  SPLIT_CPU_ONLY_MODE
 #endif
 #include "../../include/splitvector/splitvec.h"
+#include "../../include/splitvector/segmented_splitvec.h"
+
+// The concurrent push back tests need std::atomic_ref, do not let them compile away silently
+#ifndef __cpp_lib_atomic_ref
+#error "The host SplitVector tests need -std=c++20"
+#endif
 
 #define expect_true EXPECT_TRUE
 #define expect_false EXPECT_FALSE
@@ -17,6 +24,7 @@ typedef split::SplitVector<int> vec ;
 typedef std::vector<int> stdvec ;
 typedef split::SplitVector<split::SplitVector<int>> vec2d ;
 typedef split::SplitVector<int>::iterator   split_iterator;
+typedef split::SegmentedSplitVector<int,DefaultAllocator<int>,6> segvec ;
 
 
 
@@ -205,7 +213,8 @@ TEST(Vector_Functionality , Shrink_to_Fit){
    size_t initial_size=a.size();
    size_t initial_cap=a.capacity();
 
-   for (int i =0 ; i< 1024; i++){
+   // Capacity doubles from 1, so stop short of a power of two
+   for (int i =0 ; i< 1000; i++){
       a.push_back(i);
    }
 
@@ -385,6 +394,44 @@ TEST(Vector_Functionality , Erase_Range){
       expect_true(a==b);
 }
 
+TEST(Vector_Functionality , Bulk_Moves_In_The_Middle){
+   vec a{0,1,2,3,4,5,6,7,8,9};
+   vec b{-1,-2,-3};
+   a.insert(a.begin()+2,b.begin(),b.end());
+   const int afterInsert[]={0,1,-1,-2,-3,2,3,4,5,6,7,8,9};
+   expect_eq(a.size(),13);
+   for (size_t i=0; i<a.size(); ++i){
+      expect_eq(a[i],afterInsert[i]);
+   }
+   a.erase(a.begin()+1,a.begin()+4);
+   a.erase(a.begin()+5);
+   const int afterErase[]={0,-3,2,3,4,6,7,8,9};
+   expect_eq(a.size(),9);
+   for (size_t i=0; i<a.size(); ++i){
+      expect_eq(a[i],afterErase[i]);
+   }
+   a.emplace(a.begin()+1,42);
+   expect_eq(a[0],0);
+   expect_eq(a[1],42);
+   expect_eq(a[2],-3);
+   expect_eq(a.back(),9);
+
+   // Large enough for the copies to be split over threads
+   vec big(1<<22);
+   for (size_t i=0; i<big.size(); ++i){
+      big[i]=i;
+   }
+   vec copy(big);
+   vec assigned;
+   assigned=big;
+   big.reserve(big.size()*4);
+   for (size_t i=0; i<copy.size(); i+=997){
+      expect_eq(copy[i],(int)i);
+      expect_eq(assigned[i],(int)i);
+      expect_eq(big[i],(int)i);
+   }
+}
+
 TEST(Vector_Functionality , Emplace_Back){
    vec a;
    for (auto i=a.begin(); i!=a.end();i++){
@@ -444,6 +491,177 @@ TEST(Vector_Functionality , Iterator_Arithmetics){
 
 }
 
+#ifdef __cpp_lib_atomic_ref
+TEST(Vector_Functionality , Concurrent_Push_Back){
+   const int nThreads=8;
+   const int perThread=9999;
+   vec a;
+   a.reserve(nThreads*perThread/2);
+   std::vector<std::vector<int>> failed(nThreads);
+   std::vector<std::thread> workers;
+   for (int t=0; t<nThreads; ++t){
+      workers.emplace_back([&,t](){
+         // Single elements where i%3==0, blocks of two starting where i%3==1
+         for (int i=0; i<perThread;){
+            const int v=t*perThread+i;
+            if (i%3==0){
+               if (!a.concurrent_push_back(v)){failed[t].push_back(v);}
+               i++;
+            }else{
+               int pair[2]={v,v+1};
+               if (!a.concurrent_append(pair,2)){failed[t].insert(failed[t].end(),pair,pair+2);}
+               i+=2;
+            }
+         }
+      });
+   }
+   for (auto& w:workers){
+      w.join();
+   }
+   expect_eq(a.size(),a.capacity());
+   // The vector is full, so it has to grow from a single thread before retrying
+   a.reserve(nThreads*perThread);
+   for (auto& f:failed){
+      expect_true(a.concurrent_append(f.data(),f.size()));
+   }
+   expect_eq(a.size(),nThreads*perThread);
+   std::vector<int> seen(nThreads*perThread,0);
+   for (size_t i=0; i<a.size(); ++i){
+      seen[a[i]]++;
+      // Appended blocks stay contiguous
+      if ((a[i]%perThread)%3==1){
+         expect_eq(a[i+1],a[i]+1);
+      }
+   }
+   for (auto s:seen){
+      expect_eq(s,1);
+   }
+   while (a.size()<a.capacity()){
+      expect_true(a.concurrent_push_back(0));
+   }
+   expect_false(a.concurrent_push_back(0));
+   int block[2]={0,0};
+   expect_false(a.concurrent_append(block,2));
+}
+#endif
+
+TEST(Vector_Functionality , Growth_Policy){
+   vec a(100);
+   a.push_back(1);
+   expect_eq(a.capacity(),200);
+   // Growth follows the capacity, not the request
+   a.reserve(1000);
+   expect_eq(a.capacity(),1000);
+   a.set_growth_policy(split::GrowthPolicy::geometric(1.5));
+   a.resize(1001);
+   expect_eq(a.capacity(),1500);
+   a.set_growth_policy(split::GrowthPolicy::fixed_increment(64));
+   a.resize(1501);
+   expect_eq(a.capacity(),1564);
+   a.set_growth_policy(split::GrowthPolicy::exact_fit());
+   a.resize(1565);
+   expect_eq(a.capacity()*sizeof(int)%split::GrowthPolicy::PAGE_BYTES,0);
+   expect_true(a.capacity()>=1565 && a.capacity()<1565+1024);
+   vec b(std::move(a));
+   expect_true(b.growth_policy().kind()==split::GrowthPolicy::Kind::exact_fit);
+   expect_eq(b.size(),1565);
+}
+
+TEST(Vector_Functionality , Memory_Budget){
+   const size_t base=split::memory_budget::in_use();
+   {
+      vec a(1000);
+      expect_eq(split::memory_budget::in_use(),base+1000*sizeof(int));
+      split::memory_budget::set(base+3000*sizeof(int));
+      // 2x growth would need 1000+2000 ints next to the old buffer, so it is clamped to what is left
+      a.resize(1001);
+      expect_eq(a.capacity(),2000);
+      a.shrink_to_fit();
+      expect_eq(a.capacity(),1001);
+      bool threw=false;
+      try {
+         a.reserve(2500);
+      } catch (const std::bad_alloc&) {
+         threw=true;
+      }
+      expect_true(threw);
+      expect_eq(a.size(),1001);
+      expect_eq(a.capacity(),1001);
+      split::memory_budget::unlimited();
+   }
+   expect_eq(split::memory_budget::in_use(),base);
+}
+
+TEST(Segmented_Vector , Push_Back_Keeps_Addresses){
+   segvec a;
+   a.push_back(0);
+   int* first=&a[0];
+   for (int i=1; i<1000; ++i){
+      a.push_back(i);
+   }
+   expect_true(first==&a[0]);
+   expect_eq(a.size(),1000);
+   expect_eq(a.capacity(),16*segvec::chunk_size());
+   int expected=0;
+   for (auto v:a){
+      expect_eq(v,expected++);
+   }
+   expect_eq(a.end()-a.begin(),1000);
+   expect_eq(*(a.begin()+500),500);
+   a.pop_back();
+   expect_eq(a.back(),998);
+   segvec b(a);
+   expect_eq(b.size(),999);
+   expect_eq(b[998],998);
+   a.clear();
+   expect_true(a.empty());
+   expect_eq(a.capacity(),16*segvec::chunk_size());
+}
+
+TEST(Segmented_Vector , Parallel_Append_And_Seal){
+   segvec a;
+   for (int i=0; i<10; ++i){
+      a.push_back(-1);
+   }
+   const size_t n=100000;
+   split::tools::parallel_for(n,[&](size_t begin,size_t end,size_t){
+      auto appender=a.appender();
+      for (size_t i=begin; i<end; ++i){
+         appender.push_back(i);
+      }
+   },1000,8);
+   a.seal();
+   expect_eq(a.size(),n+10);
+   std::vector<int> seen(n,0);
+   for (size_t i=0; i<a.size(); ++i){
+      if (i<10){
+         expect_eq(a[i],-1);
+      }else{
+         seen[a[i]]++;
+      }
+   }
+   for (auto s:seen){
+      expect_eq(s,1);
+   }
+   // Serial appends continue after the sealed elements
+   a.push_back(7);
+   expect_eq(a.size(),n+11);
+   expect_eq(a.back(),7);
+}
+
+TEST(Segmented_Vector , Copy_If){
+   segvec a(5000,0);
+   for (int i=0; i<5000; ++i){
+      a[i]=i;
+   }
+   segvec out;
+   size_t len=split::tools::copy_if(a,out,[](int v){return v%3==0;});
+   expect_eq(len,1667);
+   for (size_t i=0; i<out.size(); ++i){
+      expect_eq(out[i],3*(int)i);
+   }
+}
+
 
 int main(int argc, char* argv[]){
    ::testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,106 @@
+#include <iostream>
+#include <stdlib.h>
+#include <random>
+#include <unordered_set>
+#include "../../include/hashinator/hashset.h"
+#include <gtest/gtest.h>
+
+#define expect_true EXPECT_TRUE
+#define expect_false EXPECT_FALSE
+#define expect_eq EXPECT_EQ
+
+using namespace Hashinator;
+typedef uint32_t key_type;
+typedef split::SplitVector<key_type> vector;
+typedef Hashset<key_type> hashset;
+
+void create_random_keys(vector& src, size_t range){
+   std::mt19937 gen(1234);
+   std::uniform_int_distribution<key_type> dist(0,range);
+   for (size_t i=0; i<src.size(); ++i){
+      src[i]=dist(gen);
+   }
+}
+
+TEST(HashsetUnitTests , Host_Point_Insert_Contains_Erase){
+   hashset set;
+   std::unordered_set<key_type> reference;
+   vector keys(1<<14);
+   create_random_keys(keys,1<<13);
+   for (const auto& k : keys){
+      expect_eq(set.insert(k),reference.insert(k).second);
+   }
+   expect_eq(set.size(),reference.size());
+   for (key_type k=0; k<(1<<13); k+=2){
+      expect_eq(set.erase(k),reference.erase(k));
+   }
+   expect_eq(set.size(),reference.size());
+   for (key_type k=0; k<(1<<14); ++k){
+      expect_eq(set.contains(k),reference.count(k)==1);
+   }
+   // Reinserting erased keys reuses their tombstones
+   for (key_type k=0; k<(1<<13); k+=2){
+      expect_true(set.insert(k));
+   }
+   expect_eq(set.size(),reference.size()+(1<<12));
+   size_t visited=0;
+   for (auto it=set.begin(); it!=set.end(); ++it){
+      expect_true(set.contains(*it));
+      visited++;
+   }
+   expect_eq(visited,set.size());
+}
+
+TEST(HashsetUnitTests , Bulk_Insert_Contains_Erase_Extract){
+   for (int power=8; power<20; power+=3){
+      const size_t N=1<<power;
+      vector keys(N);
+      create_random_keys(keys,N);
+      std::unordered_set<key_type> reference(keys.begin(),keys.end());
+
+      hashset set;
+      set.insert(keys.data(),keys.size());
+      expect_eq(set.size(),reference.size());
+      expect_true(set.load_factor()<=0.5);
+
+      // Half of the queries miss
+      vector queries(2*N);
+      for (size_t i=0; i<queries.size(); ++i){
+         queries[i]=i;
+      }
+      split::SplitVector<bool> found(queries.size());
+      set.contains(queries.data(),found.data(),queries.size());
+      for (size_t i=0; i<queries.size(); ++i){
+         expect_eq(found[i],reference.count(queries[i])==1);
+      }
+
+      vector toErase(N/2);
+      for (size_t i=0; i<toErase.size(); ++i){
+         toErase[i]=keys[i];
+         reference.erase(keys[i]);
+      }
+      set.erase(toErase.data(),toErase.size());
+      expect_eq(set.size(),reference.size());
+
+      vector extracted;
+      const size_t n=set.extractAllKeys(extracted);
+      expect_eq(n,reference.size());
+      std::unordered_set<key_type> unique;
+      for (size_t i=0; i<n; ++i){
+         expect_eq(reference.count(extracted[i]),1);
+         unique.insert(extracted[i]);
+      }
+      expect_eq(unique.size(),n);
+   }
+}
+
+TEST(HashsetUnitTests , Buckets_Hold_Keys_Only){
+   hashset set(10);
+   expect_eq(set.bucket_count()*sizeof(key_type),(1<<10)*sizeof(key_type));
+   expect_eq(sizeof(*set.expose_bucketdata<false>()),sizeof(key_type));
+}
+
+int main(int argc, char* argv[]){
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
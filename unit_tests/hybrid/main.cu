@@ -2,9 +2,19 @@
 #include <stdlib.h>
 #include <chrono>
 #include <random>
+#include <thread>
+#include <numeric>
+#include <unordered_map>
+#include <vector>
 #include "../../include/hashinator/hashinator.h"
+#include "../../include/hashinator/hashmap_pool.h"
 #include <gtest/gtest.h>
 
+// Most host APIs under test need std::atomic_ref or coroutines, do not let them compile away silently
+#if defined(HASHINATOR_CPU_ONLY_MODE) && !(defined(__cpp_lib_atomic_ref) && defined(__cpp_impl_coroutine))
+#error "The CPU only hybrid tests need -std=c++20"
+#endif
+
 
 
 #define expect_true EXPECT_TRUE
@@ -83,6 +93,926 @@ TEST(HashmapUnitTets , Host_Device_Insert_Delete_Global_Tets){
    }
 }
 
+#ifdef HASHINATOR_CPU_ONLY_MODE
+// Batch insert into a default sized map: the table is grown once to targetLF, where inserting the
+// same keys one by one only grows it when it is full and doubles it repeatedly.
+TEST(HashmapUnitTets , Host_Batch_Insert_Presizes){
+   const int power = 20;
+   const size_t N = 1<<power;
+   vector src(N);
+   create_input(src);
+   std::shuffle(src.data(),src.data()+src.size(),std::mt19937(3));
+   for (float targetLF : {0.5f,0.25f}){
+      hashmap batched;
+      bool retval = execute_and_time(("Batch insert LF="+std::to_string(targetLF)).c_str(),[&](){
+         batched.insert(src.data(),src.size(),targetLF);
+         return true;
+      });
+      expect_true(retval);
+      expect_eq(batched.size(),N);
+      expect_eq(batched.bucket_count(),size_t(1)<<(power+(targetLF<0.5f?2:1)));
+      expect_true(recover_elements(batched,src));
+   }
+   hashmap serial;
+   execute_and_time("Element wise insert",[&](){
+      for (const auto& kv : src){
+         serial[kv.first]=kv.second;
+      }
+      return true;
+   });
+   expect_eq(serial.size(),N);
+}
+
+// Batch erase leaves tombstones that the batch inserts do not reuse, so they must not starve the next batch
+TEST(HashmapUnitTets , Host_Batch_Insert_After_Batch_Erase){
+   const size_t N = 400;
+   std::vector<val_type> keys(N),vals(N);
+   hashmap hmap(10);
+   for (int round=0; round<8; ++round){
+      for (size_t i=0; i<N; ++i){
+         keys[i]=round*N+i;
+         vals[i]=i;
+      }
+      hmap.insert(keys.data(),vals.data(),N);
+      expect_eq(hmap.size(),N);
+      // Look up through a const map, which runs no cleanup in between
+      const hashmap& view=hmap;
+      size_t found=0;
+      for (size_t i=0; i<N; ++i){
+         auto it=view.find(keys[i]);
+         found+=(it!=view.end() && it->second==i);
+      }
+      expect_eq(found,N);
+      hmap.erase(keys.data(),N);
+      expect_eq(hmap.size(),0);
+   }
+}
+
+// A batch that does not fit at targetLF makes the table grow and is inserted again instead of
+// losing elements. A key repeated within the batch keeps one of its values, as on the device.
+TEST(HashmapUnitTets , Host_Batch_Insert_Overfill_And_Duplicates){
+   const size_t N = 1024;
+   std::vector<val_type> keys(N),vals(N);
+   std::iota(keys.begin(),keys.end(),0);
+   std::iota(vals.begin(),vals.end(),1);
+   hashmap hmap(9);
+   hmap.insert(keys.data(),vals.data(),N,2.0);
+   expect_true(hmap.peek_status()==status::success);
+   expect_eq(hmap.size(),N);
+   expect_true(hmap.bucket_count()>=N);
+   const hashmap& view=hmap;
+   size_t found=0;
+   for (size_t i=0; i<N; ++i){
+      auto it=view.find(keys[i]);
+      found+=(it!=view.end() && it->second==vals[i]);
+   }
+   expect_eq(found,N);
+
+   for (size_t i=0; i<N; ++i){
+      keys[i]=100000+i%8;
+   }
+   hmap.insert(keys.data(),vals.data(),N);
+   expect_eq(hmap.size(),N+8);
+   for (val_type k=0; k<8; ++k){
+      auto it=view.find(100000+k);
+      expect_true(it!=view.end() && it->second%8==(k+1)%8);
+   }
+}
+
+TEST(HashmapUnitTets , Host_Batch_Retrieve_Prefetched){
+   for (int power=5; power<18; ++power){
+      const size_t N = 1<<power;
+      vector src(N);
+      create_random_input(src);
+      hashmap hmap;
+      hmap.resize(power+1);
+      hmap.insert(src.data(),src.size());
+      split::SplitVector<val_type> keys(2*N),vals(2*N);
+      for (size_t i=0; i<N; ++i){
+         keys[2*i]=src[i].first;
+         // Keys with the top bit set are never generated by rand() so these are misses
+         keys[2*i+1]=src[i].first | (1u<<31);
+         vals[2*i+1]=42;
+      }
+      hmap.retrieve(keys.data(),vals.data(),keys.size());
+      for (size_t i=0; i<N; ++i){
+         expect_eq(vals[2*i],hmap.find(src[i].first)->second);
+         expect_eq(vals[2*i+1],42);
+      }
+      // Retrieving must not insert the missing keys
+      expect_eq(hmap.count(keys[1]),0);
+   }
+}
+
+TEST(HashmapUnitTets , Host_Batch_Contains_Bitmask_And_Slots){
+   for (int power=5; power<16; power+=5){
+      // Odd length so the last bitmask word is partial
+      const size_t N = (1<<power)+7;
+      vector src(N);
+      create_random_input(src);
+      hashmap hmap;
+      hmap.resize(power+1);
+      hmap.insert(src.data(),src.size());
+      split::SplitVector<val_type> keys(2*N);
+      for (size_t i=0; i<N; ++i){
+         keys[2*i]=src[i].first;
+         keys[2*i+1]=src[i].first | (1u<<31);
+      }
+      hmap.erase(keys[0]);
+      std::vector<uint64_t> bitmask((keys.size()+63)/64,~uint64_t(0));
+      std::vector<size_t> slots(keys.size());
+      hmap.contains(keys.data(),keys.size(),bitmask.data());
+      hmap.find_slots(keys.data(),keys.size(),slots.data());
+      for (size_t i=0; i<keys.size(); ++i){
+         const bool bit = (bitmask[i/64]>>(i%64))&1;
+         expect_eq(bit,hmap.count(keys[i])==1);
+         if (bit){
+            expect_eq(hmap.expose_bucketdata<false>()[slots[i]].first,keys[i]);
+         } else {
+            expect_eq(slots[i],hmap.bucket_count());
+         }
+      }
+      // Bits past len are cleared
+      expect_eq(bitmask.back()>>(keys.size()%64),0);
+   }
+}
+
+TEST(HashmapUnitTets , Host_Partitioned_Insert_Matches_Serial){
+   for (int power=10; power<21; power+=2){
+      const size_t N = 1<<power;
+      vector src(N);
+      create_random_input(src);
+      // Duplicate keys within the batch, the last occurrence must win as in the serial insert
+      for (size_t i=0; i<N; i+=7){
+         src[i].first=src[i/2].first;
+      }
+      std::unordered_map<val_type,val_type> reference;
+      hashmap hmap;
+      // Start from a populated map with tombstones in it
+      vector old(N/4);
+      create_input(old,1u<<31);
+      for (size_t i=0; i<old.size(); ++i){
+         reference[old[i].first]=old[i].second;
+         hmap[old[i].first]=old[i].second;
+      }
+      for (size_t i=0; i<old.size(); i+=3){
+         reference.erase(old[i].first);
+         hmap.erase(old[i].first);
+      }
+      for (size_t i=0; i<N; ++i){
+         reference[src[i].first]=src[i].second;
+      }
+      hmap.insert_partitioned(src.data(),src.size());
+      expect_eq(hmap.size(),reference.size());
+      expect_true(hmap.load_factor()<=0.5);
+      for (const auto& kval : reference){
+         auto it=hmap.find(kval.first);
+         ASSERT_TRUE(it!=hmap.end());
+         expect_eq(it->second,kval.second);
+      }
+      // A second pass only overwrites
+      hmap.insert_partitioned(src.data(),src.size());
+      expect_eq(hmap.size(),reference.size());
+   }
+}
+#endif
+
+#ifdef __cpp_lib_atomic_ref
+// Custom reducer going through the generic CAS loop
+struct BitOr{
+   static constexpr val_type identity() {return 0;}
+   val_type operator()(val_type a, val_type b) const {return a|b;}
+};
+
+TEST(HashmapUnitTets , Host_Insert_Reduce_Histogram){
+   const size_t N = 1<<18;
+   const val_type nBins = 1<<12;
+   std::mt19937 gen(42);
+   std::uniform_int_distribution<val_type> dist(0,nBins-1);
+   split::SplitVector<val_type> keys(N),vals(N);
+   std::unordered_map<val_type,val_type> sum,mn,mx,bits;
+   for (size_t i=0; i<N; ++i){
+      keys[i]=dist(gen);
+      vals[i]=gen()%1000;
+      sum[keys[i]]+=vals[i];
+      mn[keys[i]]=mn.count(keys[i])?std::min(mn[keys[i]],vals[i]):vals[i];
+      mx[keys[i]]=std::max(mx[keys[i]],vals[i]);
+      bits[keys[i]]|=vals[i];
+   }
+   // Starts small so the map has to grow before reducing
+   hashmap hsum,hmin,hmax,hbits;
+   hsum.insert_reduce(keys.data(),vals.data(),N,Reducers::Add<val_type>());
+   hmin.insert_reduce(keys.data(),vals.data(),N,Reducers::Min<val_type>());
+   hmax.insert_reduce(keys.data(),vals.data(),N,Reducers::Max<val_type>());
+   hbits.insert_reduce(keys.data(),vals.data(),N,BitOr());
+   expect_eq(hsum.size(),sum.size());
+   expect_eq(hmin.size(),sum.size());
+   for (const auto& kval : sum){
+      expect_eq(hsum.find(kval.first)->second,kval.second);
+      expect_eq(hmin.find(kval.first)->second,mn[kval.first]);
+      expect_eq(hmax.find(kval.first)->second,mx[kval.first]);
+      expect_eq(hbits.find(kval.first)->second,bits[kval.first]);
+   }
+
+   // A second batch accumulates into the existing values, erased keys start over
+   for (val_type k=0; k<nBins; k+=5){
+      if (hsum.erase(k)){ sum.erase(k); }
+   }
+   hsum.insert_reduce(keys.data(),vals.data(),N,Reducers::Add<val_type>());
+   for (size_t i=0; i<N; ++i){
+      sum[keys[i]]+=vals[i];
+   }
+   expect_eq(hsum.size(),sum.size());
+   for (const auto& kval : sum){
+      expect_eq(hsum.find(kval.first)->second,kval.second);
+   }
+
+   // operator[] fills a map almost completely and places keys past the overflow window, where
+   // the reduction has to find them again after its retry rehash instead of adding duplicates
+   hashmap dense(10);
+   for (val_type k=0; k<1000; ++k){
+      dense[k*7919]=k;
+   }
+   for (val_type k=0; k<1000; ++k){
+      val_type key=k*7919,one=1;
+      dense.insert_reduce(&key,&one,1,Reducers::Add<val_type>(),1.0);
+   }
+   expect_eq(dense.size(),1000);
+   for (val_type k=0; k<1000; ++k){
+      expect_eq(dense.find(k*7919)->second,k+1);
+   }
+
+   // Keys created afterwards start from a value initialised bucket, not from a leftover identity
+   expect_eq(hmin[nBins+1],0);
+   hmin.erase(0);
+   expect_eq(hmin[0],0);
+}
+
+// Floating point values have no native atomics for every reducer and go through the CAS on their
+// bit pattern. Whole numbers keep the sums exact whatever order they are added in.
+TEST(HashmapUnitTets , Host_Insert_Reduce_Floating_Point){
+   const size_t N = 1<<16;
+   const val_type nBins = 1<<8;
+   std::mt19937 gen(7);
+   split::SplitVector<val_type> keys(N);
+   split::SplitVector<float> vals(N);
+   std::unordered_map<val_type,float> sum,mn,mx;
+   for (size_t i=0; i<N; ++i){
+      keys[i]=gen()%nBins;
+      vals[i]=float(gen()%1000)-500.0f;
+      sum[keys[i]]+=vals[i];
+      mn[keys[i]]=mn.count(keys[i])?std::min(mn[keys[i]],vals[i]):vals[i];
+      mx[keys[i]]=mx.count(keys[i])?std::max(mx[keys[i]],vals[i]):vals[i];
+   }
+   Hashmap<val_type,float> hsum,hmin,hmax;
+   hsum.insert_reduce(keys.data(),vals.data(),N,Reducers::Add<float>());
+   hmin.insert_reduce(keys.data(),vals.data(),N,Reducers::Min<float>());
+   hmax.insert_reduce(keys.data(),vals.data(),N,Reducers::Max<float>());
+   expect_eq(hsum.size(),sum.size());
+   for (const auto& kval : sum){
+      expect_eq(hsum.find(kval.first)->second,kval.second);
+      expect_eq(hmin.find(kval.first)->second,mn[kval.first]);
+      expect_eq(hmax.find(kval.first)->second,mx[kval.first]);
+   }
+}
+#endif
+
+#ifdef HASHINATOR_CPU_ONLY_MODE
+#ifdef __cpp_lib_atomic_ref
+TEST(HashmapUnitTets , Host_Merge_Partial_Maps){
+   const size_t nPartials = 16;
+   const size_t N = 1<<14;
+   std::mt19937 gen(7);
+   std::uniform_int_distribution<val_type> dist(0,4*N);
+   std::vector<hashmap> partials(nPartials);
+   std::unordered_map<val_type,val_type> reference;
+   for (auto& partial : partials){
+      for (size_t i=0; i<N; ++i){
+         const val_type key=dist(gen);
+         partial[key]+=1;
+         reference[key]+=1;
+      }
+   }
+   hashmap global;
+   for (const auto& partial : partials){
+      global.merge(partial,Reducers::Add<val_type>());
+      // Presized for disjoint keys, so merging never leaves the map above targetLF
+      expect_true(global.load_factor()<=0.5);
+   }
+   expect_eq(global.size(),reference.size());
+   for (const auto& kval : reference){
+      expect_eq(global.find(kval.first)->second,kval.second);
+   }
+}
+#endif
+
+TEST(HashmapUnitTets , Host_Hugepage_Buckets){
+   using hugemap = Hashmap<val_type,val_type,std::numeric_limits<val_type>::max(),std::numeric_limits<val_type>::max()-1,
+                           HashFunctions::Fibonacci<val_type>,void,split::split_hugepage_allocator<MapInfo>>;
+   const size_t N = 1<<18;
+   vector src(N);
+   for (size_t i=0; i<N; ++i){
+      src[i]={val_type(3*i+1),val_type(i)};
+   }
+   hugemap hmap;
+   hmap.insert(src.data(),src.size());
+   // Buckets past 2 MB come from a 2 MB aligned mapping
+   expect_eq(reinterpret_cast<uintptr_t>(hmap.expose_bucketdata<false>())%(1ul<<21),0);
+   hugemap copy(hmap);
+   hmap.clear();
+   expect_eq(copy.size(),N);
+   for (const auto& kval : src){
+      expect_eq(copy.find(kval.first)->second,kval.second);
+   }
+}
+
+// Minimal allocator without a nested rebind, the buckets get theirs through std::allocator_traits
+template <typename T>
+struct MinimalAllocator{
+   using value_type=T;
+   MinimalAllocator()=default;
+   template <typename U>
+   MinimalAllocator(const MinimalAllocator<U>&) noexcept {}
+   T* allocate(size_t n){return std::allocator<T>().allocate(n);}
+   void deallocate(T* p, size_t n) noexcept {std::allocator<T>().deallocate(p,n);}
+   template <typename U>
+   bool operator==(const MinimalAllocator<U>&) const noexcept {return true;}
+   template <typename U>
+   bool operator!=(const MinimalAllocator<U>&) const noexcept {return false;}
+};
+
+TEST(HashmapUnitTets , Host_Allocator_Without_Rebind){
+   using minimalmap = Hashmap<val_type,val_type,std::numeric_limits<val_type>::max(),
+                              std::numeric_limits<val_type>::max()-1,HashFunctions::Fibonacci<val_type>,
+                              void,MinimalAllocator<MapInfo>>;
+   minimalmap hmap;
+   for (val_type k=0; k<1000; ++k){
+      hmap[k]=2*k;
+   }
+   expect_eq(hmap.size(),1000);
+   expect_eq(hmap.find(321)->second,642);
+}
+
+TEST(HashmapUnitTets , Host_Parallel_ForEach_Transform_Reduce){
+   const size_t N = 1<<17;
+   hashmap hmap;
+   for (val_type k=0; k<N; ++k){
+      hmap[k]=2*k;
+   }
+   for (val_type k=0; k<N; k+=4){
+      hmap.erase(k);
+   }
+   uint64_t expected=0;
+   for (val_type k=0; k<N; ++k){
+      if (k%4!=0){ expected+=k+1; }
+   }
+   hmap.transform_values([](const val_type& key, const val_type& value){ expect_eq(value,2*key); return value/2; });
+   hmap.for_each([](const val_type&, val_type& value){ value+=1; });
+   auto sum = [](uint64_t a, uint64_t b){ return a+b; };
+   expect_eq(hmap.reduce(uint64_t(0),sum),expected);
+   expect_eq(hmap.reduce(uint64_t(0),sum,[](const val_type&, const val_type&){ return uint64_t(1); }),hmap.size());
+   for (val_type k=0; k<N; ++k){
+      expect_eq(hmap.count(k),k%4==0?0:1);
+   }
+   hashmap empty;
+   expect_eq(empty.reduce(uint64_t(42),sum),42);
+}
+
+// Traversal with the occupancy bitmap must visit exactly the buckets a plain scan visits
+void expect_occupancy_exact(const hashmap& hmap){
+   hashmap plain(hmap);
+   plain.track_occupancy(false);
+   expect_true(hmap.tracks_occupancy());
+   expect_eq(hmap.count_occupied(),hmap.size());
+   auto it=hmap.begin();
+   for (auto ref=plain.begin(); ref!=plain.end(); ++ref,++it){
+      ASSERT_TRUE(it!=hmap.end());
+      expect_eq(it->first,ref->first);
+   }
+   expect_true(it==hmap.end());
+}
+
+TEST(HashmapUnitTets , Host_Occupancy_Bitmap){
+   const size_t N = 1<<16;
+   hashmap hmap;
+   hmap.track_occupancy();
+   expect_occupancy_exact(hmap);
+   for (val_type k=0; k<N; ++k){
+      hmap[k]=k;
+   }
+   expect_occupancy_exact(hmap);
+   // Sparse table after a big erase, then tombstones get reused
+   for (val_type k=0; k<N; ++k){
+      if (k%20!=0){ hmap.erase(k); }
+   }
+   expect_eq(hmap.size(),N/20+1);
+   expect_occupancy_exact(hmap);
+   for (val_type k=0; k<N; k+=7){
+      hmap[k]=k;
+   }
+   expect_occupancy_exact(hmap);
+
+   vector src(N);
+   for (size_t i=0; i<N; ++i){
+      src[i]={val_type(N+13*i),val_type(i)};
+   }
+   hmap.insert_partitioned(src.data(),src.size());
+   expect_occupancy_exact(hmap);
+#ifdef __cpp_lib_atomic_ref
+   for (size_t i=0; i<N; i+=3){
+      hmap.concurrent_erase(src[i].first);
+   }
+   expect_occupancy_exact(hmap);
+   split::SplitVector<val_type> keys(N),vals(N,1);
+   for (size_t i=0; i<N; ++i){
+      keys[i]=3*N+i;
+   }
+   hmap.insert_reduce(keys.data(),vals.data(),N,Reducers::Add<val_type>());
+   expect_occupancy_exact(hmap);
+#endif
+   // Small batches update the bitmap key by key, large ones rebuild it
+   for (size_t len : {size_t(64),size_t(N)}){
+      split::SplitVector<val_type> batch(len),ones(len,1);
+      for (size_t i=0; i<len; ++i){
+         batch[i]=5*N+7*i;
+      }
+      hmap.insert(batch.data(),ones.data(),len);
+      expect_occupancy_exact(hmap);
+      hmap.erase(batch.data(),len/2);
+      expect_occupancy_exact(hmap);
+   }
+   hashmap odd;
+   for (val_type k=1; k<4*N; k+=2){
+      odd[k]=0;
+   }
+   hmap.subtract(odd);
+   expect_occupancy_exact(hmap);
+
+   split::SplitVector<val_type> extracted;
+   expect_eq(hmap.extractAllKeys(extracted),hmap.size());
+   for (const auto& k : extracted){
+      expect_eq(hmap.count(k),1);
+   }
+   hmap.clear();
+   expect_occupancy_exact(hmap);
+   expect_true(hmap.begin()==hmap.end());
+}
+
+TEST(HashmapUnitTets , Host_Shrink_Policy){
+   const size_t N = 1<<16;
+   hashmap hmap;
+   for (val_type k=0; k<N; ++k){
+      hmap[k]=k;
+   }
+   const size_t peak = hmap.bucket_count();
+   // Without a policy the map keeps its peak size
+   for (val_type k=1000; k<N; ++k){
+      hmap.erase(k);
+   }
+   hmap.performCleanupTasks();
+   expect_eq(hmap.bucket_count(),peak);
+
+   EXPECT_THROW(hmap.set_shrink_policy(0.3,0.5),std::invalid_argument);
+   hmap.set_shrink_policy(0.1,0.5);
+   hmap.performCleanupTasks();
+   expect_eq(hmap.bucket_count(),2048);
+   expect_eq(hmap.tombstone_count(),0);
+   for (val_type k=0; k<1000; ++k){
+      expect_eq(hmap.find(k)->second,k);
+   }
+   // Hysteresis: halving the contents stays above the low water mark
+   for (val_type k=500; k<1000; ++k){
+      hmap.erase(k);
+   }
+   hmap.performCleanupTasks();
+   expect_eq(hmap.bucket_count(),2048);
+   // erase() runs the cleanup too, so the map shrinks as soon as 204 elements are left
+   for (val_type k=100; k<500; ++k){
+      hmap.erase(k);
+   }
+   hmap.performCleanupTasks();
+   expect_eq(hmap.bucket_count(),512);
+   hmap.clear();
+   hmap.performCleanupTasks();
+   expect_eq(hmap.bucket_count(),32);
+   expect_eq(hmap.size(),0);
+}
+
+TEST(HashmapUnitTets , Host_Clear_In_Place){
+   hashmap hmap(12);
+   for (val_type k=0; k<1000; ++k){
+      hmap[k]=k+1;
+   }
+   for (val_type k=0; k<1000; k+=5){
+      hmap.erase(k);
+   }
+   auto* data = hmap.expose_bucketdata<false>();
+   const size_t buckets = hmap.bucket_count();
+   hmap.clear();
+   expect_eq(hmap.size(),0);
+   expect_eq(hmap.tombstone_count(),0);
+   expect_eq(hmap.bucket_count(),buckets);
+   expect_true(hmap.expose_bucketdata<false>()==data);
+   expect_true(hmap.begin()==hmap.end());
+   // New buckets must hand out default values again
+   for (val_type k=0; k<1000; ++k){
+      expect_eq(hmap.count(k),0);
+      expect_eq(hmap[k],0);
+   }
+}
+
+TEST(HashmapUnitTets , Host_Hashmap_Pool){
+   HashmapPool<hashmap> pool(4);
+   hashmap* first;
+   {
+      auto hmap = pool.acquire(6);
+      first = hmap.get();
+      expect_eq(hmap->bucket_count(),64);
+      for (val_type k=0; k<20; ++k){
+         (*hmap)[k]=k;
+      }
+   }
+   expect_eq(pool.idle(6),1);
+   {
+      // The same map comes back, empty
+      auto hmap = pool.acquire(6);
+      expect_true(hmap.get()==first);
+      expect_eq(hmap->size(),0);
+      expect_eq(pool.idle(6),0);
+      // A map that grows is returned to its new size class
+      for (val_type k=0; k<200; ++k){
+         (*hmap)[k]=k;
+      }
+   }
+   expect_eq(pool.idle(6),0);
+   expect_eq(pool.idle(8),1);
+
+   std::vector<std::thread> workers;
+   for (int t=0; t<8; ++t){
+      workers.emplace_back([&pool,t](){
+         for (int i=0; i<200; ++i){
+            auto hmap = pool.acquire(5);
+            for (val_type k=0; k<16; ++k){
+               (*hmap)[k]=k+t;
+            }
+            expect_eq(hmap->size(),16);
+            expect_eq((*hmap)[3],3+t);
+         }
+      });
+   }
+   for (auto& w : workers){
+      w.join();
+   }
+   expect_true(pool.idle(5)<=4);
+   // Sizes without a class are rejected up front and never pooled
+   EXPECT_THROW(pool.reserve(40,1),std::invalid_argument);
+   expect_eq(pool.idle(40),0);
+   expect_eq(pool.idle(-1),0);
+   pool.trim();
+   expect_eq(pool.idle(5),0);
+   expect_eq(pool.idle(8),0);
+}
+
+TEST(HashmapUnitTets , Host_Bloom_Filter){
+   const size_t N = 1<<16;
+   BlockedBloomFilter filter(N,0.01);
+   for (val_type k=0; k<N; ++k){
+      filter.insert(k);
+   }
+   size_t falsePositives=0;
+   for (val_type k=0; k<N; ++k){
+      expect_true(filter.may_contain(k));
+      falsePositives+=filter.may_contain(k+N);
+   }
+   expect_true(falsePositives<N/50);
+
+   hashmap hmap;
+   hmap.enable_bloom_filter();
+   expect_true(hmap.has_bloom_filter());
+   for (val_type k=0; k<N; ++k){
+      hmap[2*k]=k;
+   }
+   // Growing rehashes the map and rebuilds the filter for the new bucket count
+   vector src(N);
+   for (val_type k=0; k<N; ++k){
+      src[k]=hash_pair<val_type,val_type>(2*k+1,k);
+   }
+   hmap.insert_partitioned(src.data(),N);
+   for (val_type k=0; k<N; k+=2){
+      hmap.erase(2*k);
+   }
+   for (val_type k=0; k<N; ++k){
+      expect_eq(hmap.count(2*k),k%2?1:0);
+      expect_eq(hmap.count(2*k+1),1);
+      expect_eq(hmap.count(2*k+4*N),0);
+   }
+   // A small batch adds its keys to the filter without rebuilding it
+   split::SplitVector<val_type> batch(64),vals(64,7);
+   for (size_t i=0; i<batch.size(); ++i){
+      batch[i]=8*N+i;
+   }
+   hmap.insert(batch.data(),vals.data(),batch.size());
+   const hashmap& view=hmap;
+   for (const auto& k : batch){
+      expect_true(view.find(k)!=view.end());
+   }
+   hmap.erase(batch.data(),batch.size());
+   hmap.rehash(hmap.getSizePower()+1);
+   expect_eq(hmap.find(3)->second,1);
+   hmap.disable_bloom_filter();
+   expect_false(hmap.has_bloom_filter());
+   expect_eq(hmap.size(),N+N/2);
+}
+
+TEST(HashmapUnitTets , Host_Intersect_Subtract){
+   const size_t N = 1<<16;
+   hashmap a,b,c;
+   for (val_type k=0; k<N; ++k){
+      a[k]=k;
+      b[k]=k;
+      if (k%3==0){ c[k]=0; }
+   }
+   // Tombstones in the queried map must not hide keys behind them
+   for (val_type k=0; k<N; k+=6){
+      c.erase(k);
+   }
+   a.intersect(c);
+   b.subtract(c);
+   expect_eq(a.size()+b.size(),N);
+   for (val_type k=0; k<N; ++k){
+      const bool inC = (k%3==0) && (k%6!=0);
+      expect_eq(a.count(k),inC?1:0);
+      expect_eq(b.count(k),inC?0:1);
+      if (inC){
+         expect_eq(a.find(k)->second,k);
+      }
+   }
+   hashmap empty;
+   b.intersect(empty);
+   expect_eq(b.size(),0);
+}
+#endif
+
+
+#ifdef __cpp_impl_coroutine
+LookupTask interleaved_lookup(hashmap& hmap, const vector& src, size_t first, size_t stride, size_t& hits, size_t& misses){
+   for (size_t i=first; i<src.size(); i+=stride){
+      auto it = co_await hmap.async_find(src[i].first);
+      if (it!=hmap.end() && it->second==src[i].second){hits++;}
+      auto miss = co_await hmap.async_find(src[i].first | (1u<<31));
+      if (miss==hmap.end()){misses++;}
+   }
+}
+
+TEST(HashmapUnitTets , Host_Coroutine_Interleaved_Find){
+   const int power=16;
+   const size_t N = 1<<power;
+   vector src(N);
+   create_input(src);
+   hashmap hmap;
+   hmap.resize(power+1);
+   hmap.insert(src.data(),src.size());
+
+   for (size_t inFlight : {1,4,16,64}){
+      LookupScheduler scheduler;
+      std::vector<size_t> hits(inFlight,0), misses(inFlight,0);
+      for (size_t t=0; t<inFlight; ++t){
+         scheduler.spawn(interleaved_lookup(hmap,src,t,inFlight,hits[t],misses[t]));
+      }
+      scheduler.run();
+      expect_eq(std::accumulate(hits.begin(),hits.end(),size_t(0)),N);
+      expect_eq(std::accumulate(misses.begin(),misses.end(),size_t(0)),N);
+   }
+}
+#endif
+
+#ifdef __cpp_lib_atomic_ref
+TEST(HashmapUnitTets , Host_Concurrent_Insert_Find_Erase){
+   const int nThreads = std::max(2u, std::thread::hardware_concurrency());
+   const size_t perThread = 1<<14;
+   hashmap hmap;
+   hmap.resize(std::ceil(std::log2(2*nThreads*perThread)));
+
+   auto inserter = [&](int tid){
+      for (size_t i=0; i<perThread; ++i){
+         val_type key = tid*perThread + i;
+         while (hmap.concurrent_insert(key,key+1)!=status::success){std::this_thread::yield();}
+      }
+   };
+   std::vector<std::thread> workers;
+   for (int t=0; t<nThreads; ++t){workers.emplace_back(inserter,t);}
+   for (auto& w:workers){w.join();}
+   workers.clear();
+   expect_eq(hmap.size(), nThreads*perThread);
+
+   // Every thread looks up everything and erases its even keys
+   std::atomic<size_t> missing{0};
+   auto eraser = [&](int tid){
+      for (size_t i=0; i<perThread; ++i){
+         val_type key = tid*perThread + i;
+         val_type val;
+         if (!hmap.concurrent_find(key,val) || val!=key+1){missing++;}
+         if (i%2==0){ hmap.concurrent_erase(key);}
+      }
+   };
+   for (int t=0; t<nThreads; ++t){workers.emplace_back(eraser,t);}
+   for (auto& w:workers){w.join();}
+   expect_eq(missing.load(), 0);
+   expect_eq(hmap.size(), nThreads*perThread/2);
+   expect_eq(hmap.tombstone_count(), nThreads*perThread/2);
+   for (size_t key=0; key<nThreads*perThread; ++key){
+      val_type val;
+      expect_eq(hmap.concurrent_find(key,val), key%perThread%2!=0);
+   }
+}
+
+TEST(HashmapUnitTets , Host_Concurrent_Insert_Signals_Growth){
+   hashmap hmap(4);
+   size_t inserted=0;
+   val_type key=0;
+   for (; key<(1<<10); ++key){
+      if (hmap.concurrent_insert(key,key)!=status::success){break;}
+      inserted++;
+   }
+   expect_true(inserted<(1<<10));
+   expect_eq(hmap.size(), inserted);
+   // Grow from a single thread and retry
+   hmap.resize(hmap.getSizePower()+4);
+   expect_eq(hmap.concurrent_insert(key,key), status::success);
+   expect_eq(hmap.size(), inserted+1);
+}
+#endif
+
+#if defined(HASHINATOR_CPU_ONLY_MODE) && defined(__cpp_lib_atomic_ref)
+TEST(HashmapUnitTets , Host_Hasher_Backend){
+   const size_t N = 1<<16;
+   std::vector<val_type> keys(N);
+   std::iota(keys.begin(),keys.end(),0);
+   std::shuffle(keys.begin(),keys.end(),std::mt19937(7));
+   // Batch insert and erase through the host Hasher of a default map
+   hashmap hmap;
+   hmap.track_occupancy();
+   hmap.insertIndex(keys.data(),N);
+   expect_eq(hmap.peek_status(),status::success);
+   expect_eq(hmap.size(),N);
+   expect_true(hmap.load_factor()<=0.5);
+   for (size_t i=0; i<N; ++i){
+      expect_eq(hmap.find(keys[i])->second,i);
+   }
+   hmap.erase(keys.data(),N/2);
+   // Keys repeated in a batch are only erased once
+   hmap.erase(keys.data(),N/2);
+   expect_eq(hmap.size(),N-N/2);
+   expect_eq(hmap.count_occupied(),N-N/2);
+   for (size_t i=0; i<N; ++i){
+      expect_eq(hmap.count(keys[i]),i>=N/2);
+   }
+   // Batch insert of the erased half, with the keys as values, through the same hasher
+   hmap.insert(keys.data(),keys.data(),N/2);
+   expect_eq(hmap.peek_status(),status::success);
+   expect_eq(hmap.size(),N);
+   expect_eq(hmap.count_occupied(),N);
+   std::vector<val_type> vals(N);
+   hmap.retrieve(keys.data(),vals.data(),N);
+   for (size_t i=0; i<N; ++i){
+      expect_eq(vals[i],i<N/2?keys[i]:i);
+   }
+
+   // Kernels with two elements per virtual warp on raw buckets
+   using hasher=Hashers::Hasher<val_type,val_type,HashFunctions::Fibonacci<val_type>,
+                                std::numeric_limits<val_type>::max(),std::numeric_limits<val_type>::max()-1,
+                                defaults::WARPSIZE,2>;
+   const int sizePower=12;
+   Info info(sizePower);
+   info.fill=0;
+   vector buckets(1<<sizePower,hash_pair<val_type,val_type>(std::numeric_limits<val_type>::max(),0));
+   vector src(1500);
+   for (size_t i=0; i<src.size(); ++i){
+      src[i]=hash_pair<val_type,val_type>(i%1000,i);
+   }
+   hasher::insert(src.data(),buckets.data(),&info,src.size());
+   expect_eq(info.err,status::success);
+   expect_eq(info.fill,1000);
+   expect_eq(info.currentMaxBucketOverflow%(defaults::WARPSIZE/2),0);
+   vector query(1001);
+   for (size_t i=0; i<query.size(); ++i){
+      query[i]=hash_pair<val_type,val_type>(i,12345);
+   }
+   hasher::retrieve(query.data(),buckets.data(),&info,query.size());
+   for (size_t i=0; i<1000; ++i){
+      // Duplicates race, so the value is either of the two inserted ones
+      expect_true(query[i].second==i || query[i].second==i+1000);
+   }
+   expect_eq(query[1000].second,12345);
+   hasher::reset(src.data(),buckets.data(),&info,500);
+   expect_eq(info.fill,500);
+   for (auto& kv : query){
+      kv.second=12345;
+   }
+   hasher::retrieve(query.data(),buckets.data(),&info,query.size());
+   expect_eq(std::count_if(query.begin(),query.end(),[](const auto& kv){return kv.second==12345;}),501);
+
+   // A table that is too small reports the failure
+   Info tiny(4);
+   tiny.fill=0;
+   vector small(16,hash_pair<val_type,val_type>(std::numeric_limits<val_type>::max(),0));
+   hasher::insert(src.data(),small.data(),&tiny,32);
+   expect_eq(tiny.err,status::fail);
+   expect_eq(tiny.fill,16);
+}
+
+TEST(HashmapUnitTets , Host_Hasher_Dense_Erase){
+   // operator[] only grows a full table, so keys end up far past currentMaxBucketOverflow
+   std::mt19937 gen(11);
+   std::uniform_int_distribution<val_type> dist(0,std::numeric_limits<val_type>::max()-2);
+   std::vector<val_type> keys(1100);
+   std::generate(keys.begin(),keys.end(),[&](){return dist(gen);});
+   std::sort(keys.begin(),keys.end());
+   keys.erase(std::unique(keys.begin(),keys.end()),keys.end());
+   keys.resize(1000);
+   std::shuffle(keys.begin(),keys.end(),gen);
+   hashmap hmap(10);
+   for (size_t i=0; i<keys.size(); ++i){
+      hmap[keys[i]]=i;
+   }
+   expect_eq(hmap.size(),keys.size());
+   std::vector<val_type> vals(keys.size(),12345);
+   hmap.retrieve(keys.data(),vals.data(),keys.size());
+   for (size_t i=0; i<keys.size(); ++i){
+      expect_eq(vals[i],i);
+   }
+   hmap.erase(keys.data(),keys.size()/2);
+   expect_eq(hmap.size(),keys.size()-keys.size()/2);
+   for (size_t i=0; i<keys.size(); ++i){
+      expect_eq(hmap.count(keys[i]),i>=keys.size()/2);
+   }
+   hmap.erase(keys.data(),keys.size());
+   expect_eq(hmap.size(),0);
+   for (auto k : keys){
+      expect_eq(hmap.count(k),0);
+   }
+}
+
+TEST(HashmapUnitTets , Host_Streams){
+   const size_t N = 1<<15;
+   std::vector<val_type> keys(N),vals(N);
+   std::iota(keys.begin(),keys.end(),0);
+   std::shuffle(keys.begin(),keys.end(),std::mt19937(11));
+   for (size_t i=0; i<N; ++i){
+      vals[i]=2*keys[i];
+   }
+   split_gpuStream_t s1,s2;
+   split_gpuEvent_t inserted;
+   SPLIT_CHECK_ERR(split_gpuStreamCreate(&s1));
+   SPLIT_CHECK_ERR(split_gpuStreamCreate(&s2));
+   SPLIT_CHECK_ERR(split_gpuEventCreate(&inserted));
+
+   // Independent maps progress on their own streams
+   hashmap a,b;
+   a.insert(keys.data(),vals.data(),N,0.5,s1);
+   b.insertIndex(keys.data(),N,0.5,s2);
+   SPLIT_CHECK_ERR(split_gpuEventRecord(inserted,s1));
+   // s2 reads a once the insert queued in s1 is done
+   std::vector<val_type> out(N,0);
+   SPLIT_CHECK_ERR(split_gpuStreamWaitEvent(s2,inserted,0));
+   a.retrieve(keys.data(),out.data(),N,s2);
+   SPLIT_CHECK_ERR(split_gpuStreamSynchronize(s2));
+   expect_true(out==vals);
+   expect_eq(b.size(),N);
+   SPLIT_CHECK_ERR(split_gpuEventSynchronize(inserted));
+   expect_eq(split_gpuEventQuery(inserted),split_gpuSuccess);
+
+   // Tasks of a stream run in order: erase, clean the tombstones, then extract
+   vector extracted;
+   a.erase(keys.data(),N/2,s1);
+   a.clean_tombstones(s1);
+   expect_eq(a.extractPattern(extracted,[](const hash_pair<val_type,val_type>& kv){return kv.first%2==0;},s1),0);
+   SPLIT_CHECK_ERR(split_gpuStreamSynchronize(s1));
+   expect_eq(a.tombstone_count(),0);
+   expect_eq(a.size(),N-N/2);
+   size_t even=0;
+   for (size_t i=N/2; i<N; ++i){
+      even+=keys[i]%2==0;
+   }
+   expect_eq(extracted.size(),even);
+   for (const auto& kv : extracted){
+      expect_true(kv.first%2==0 && kv.second==2*kv.first);
+   }
+   // Without a stream the same call blocks and returns the count
+   expect_eq(a.extractPattern(extracted,[](const hash_pair<val_type,val_type>& kv){return kv.first%2==0;}),even);
+
+   // The first exception thrown in a stream surfaces when it is synchronized
+   s1->enqueue([](){throw std::runtime_error("task failed");});
+   s1->enqueue([&](){b.clear();});
+   EXPECT_THROW(s1->synchronize(),std::runtime_error);
+   expect_eq(b.size(),0);
+
+   SPLIT_CHECK_ERR(split_gpuEventDestroy(inserted));
+   SPLIT_CHECK_ERR(split_gpuStreamDestroy(s1));
+   SPLIT_CHECK_ERR(split_gpuStreamDestroy(s2));
+}
+#endif
+
 int main(int argc, char* argv[]){
    srand(time(NULL));
    ::testing::InitGoogleTest(&argc, argv);